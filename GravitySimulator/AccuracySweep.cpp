@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <SDL.h>
+
+#include "AccuracySweep.h"
+#include "FmmForceEngine.h"
+#include "ForceEngine.h"
+#include "FrameArena.h"
+#include "PmForceEngine.h"
+#include "Random.h"
+#include "TreeForceEngine.h"
+#include "TreePmForceEngine.h"
+
+// Global Constants
+namespace {
+
+	const int TIMED_RUNS = 3; // The fastest is kept
+	const float MAX_REPEATED_MILLISECONDS = 1000; // Slower settings are timed once
+	const int MAX_QUADRATIC_BODIES = 65536; // Direct SIMD is skipped above this
+	const int REFERENCE_GRAIN_SIZE = 16;
+
+	const float SCENE_RADIUS = 400; // [km]
+	const Vector2 SCENE_CENTER = { 640, 360 };
+	const int CLUSTER_COUNT = 5;
+	const float CLUSTER_RADIUS = 6; // [km] Plummer scale radius
+
+	const float OPENING_ANGLES[] = { 0.3f, 0.4f, 0.5f, 0.6f, 0.7f, 0.8f, 1.0f };
+	const float ERROR_TOLERANCES[] = { 1e-4f, 3e-4f, 1e-3f, 3e-3f, 1e-2f, 3e-2f };
+	const int FMM_ORDERS[] = { 2, 4, 6, 8, 10, 12, 16 };
+	const int MESH_SIZES[] = { 64, 128, 256, 512, 1024 };
+
+};
+
+// Local functions
+namespace {
+
+struct Result {
+	const char* scene;
+	const char* engine;
+	const char* parameter;
+	float value;
+	float milliseconds;
+	float rmsError;
+	float p99Error;
+	bool isPareto;
+};
+
+struct Snapshot {
+	const char* name;
+	std::vector<Mass> masses;
+	std::vector<int> sample;
+	std::vector<Vector2> reference;
+};
+
+Mass makeMass(Vector2 position)
+{
+	Mass mass;
+	mass.colorIndex = 0;
+	mass.position = position;
+	mass.velocity = { 0, 0 };
+	mass.acceleration = { 0, 0 };
+	mass.mass = 100;
+	mass.doIgnore = false;
+	return mass;
+}
+
+// Uniform disk, the same shape "Scatter masses" makes
+std::vector<Mass> makeDisk(int count, std::mt19937& random)
+{
+	std::vector<Mass> masses;
+	masses.reserve(count);
+
+	for (int i = 0; i < count; i++) {
+		float distance = SCENE_RADIUS * std::sqrt(getRandomUnit(random));
+		float angle = 2 * static_cast<float>(M_PI) * getRandomUnit(random);
+		masses.push_back(makeMass(SCENE_CENTER + Vector2{ std::cos(angle), std::sin(angle) } * distance));
+	}
+
+	return masses;
+}
+
+// Half the bodies in a disk and half in dense Plummer clusters, whose
+// heavy tails stretch the tree and the mesh over mostly empty space
+std::vector<Mass> makeClusters(int count, std::mt19937& random)
+{
+	std::vector<Mass> masses = makeDisk(count / 2, random);
+	masses.reserve(count);
+
+	std::vector<Vector2> centers(CLUSTER_COUNT);
+	for (Vector2& center : centers) {
+		float distance = 0.8f * SCENE_RADIUS * std::sqrt(getRandomUnit(random));
+		float angle = 2 * static_cast<float>(M_PI) * getRandomUnit(random);
+		center = SCENE_CENTER + Vector2{ std::cos(angle), std::sin(angle) } * distance;
+	}
+
+	for (int i = static_cast<int>(masses.size()); i < count; i++) {
+		// Inverse of the 2D Plummer cumulative mass, u = r^2 / (r^2 + a^2)
+		float u = std::min(getRandomUnit(random), 0.9999f);
+		float distance = CLUSTER_RADIUS * std::sqrt(u / (1 - u));
+		float angle = 2 * static_cast<float>(M_PI) * getRandomUnit(random);
+		masses.push_back(makeMass(centers[i % CLUSTER_COUNT] + Vector2{ std::cos(angle), std::sin(angle) } * distance));
+	}
+
+	return masses;
+}
+
+// Direct summation for evenly spaced bodies
+void computeReference(Snapshot& snapshot, int sampleSize, ThreadPool& threadPool)
+{
+	int count = static_cast<int>(snapshot.masses.size());
+	sampleSize = std::min(sampleSize, count);
+
+	snapshot.sample.resize(sampleSize);
+	snapshot.reference.resize(sampleSize);
+	for (int k = 0; k < sampleSize; k++) {
+		snapshot.sample[k] = static_cast<int>(static_cast<long long>(k) * count / sampleSize);
+	}
+
+	threadPool.parallelFor(sampleSize, REFERENCE_GRAIN_SIZE, [&](int begin, int end) {
+		for (int k = begin; k < end; k++) {
+			const Mass& mass = snapshot.masses[snapshot.sample[k]];
+			snapshot.reference[k] = getPointAcceleration(snapshot.masses, mass.position.x, mass.position.y, snapshot.sample[k]);
+		}
+	});
+}
+
+// One untimed step first, so caches are warm and the relative error
+// criterion has last step's accelerations, then the best of a few full
+// steps. Caches are reset before each, so times include tree builds, and
+// each step is a frame as far as the frame arenas are concerned.
+Result measure(ForceEngine& engine, const Snapshot& snapshot, ThreadPool& threadPool)
+{
+	Result result = {};
+	result.scene = snapshot.name;
+	result.engine = engine.name();
+
+	std::vector<Mass> masses = snapshot.masses;
+	resetFrameArenas();
+	engine.resetCaches();
+	engine.computeAccelerations(masses, threadPool);
+
+	for (int run = 0; run < TIMED_RUNS; run++) {
+		resetFrameArenas();
+		engine.resetCaches();
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		engine.computeAccelerations(masses, threadPool);
+		float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		if (run == 0 || milliseconds < result.milliseconds)
+			result.milliseconds = milliseconds;
+
+		if (milliseconds > MAX_REPEATED_MILLISECONDS)
+			break;
+	}
+
+	std::vector<float> errors;
+	errors.reserve(snapshot.sample.size());
+	for (int k = 0; k < static_cast<int>(snapshot.sample.size()); k++) {
+		float reference = getLength(snapshot.reference[k]);
+		if (reference > 0)
+			errors.push_back(getLength(masses[snapshot.sample[k]].acceleration - snapshot.reference[k]) / reference);
+	}
+
+	if (!errors.empty()) {
+		double squareSum = 0;
+		for (float error : errors) {
+			squareSum += static_cast<double>(error) * error;
+		}
+		result.rmsError = static_cast<float>(std::sqrt(squareSum / errors.size()));
+
+		std::vector<float>::iterator percentile = errors.begin() + (errors.size() * 99 - 1) / 100;
+		std::nth_element(errors.begin(), percentile, errors.end());
+		result.p99Error = *percentile;
+	}
+
+	engine.resetCaches();
+	return result;
+}
+
+void measureSettings(const Snapshot& snapshot, ThreadPool& threadPool, std::vector<Result>& results)
+{
+	if (static_cast<int>(snapshot.masses.size()) <= MAX_QUADRATIC_BODIES) {
+		SimdForceEngine direct;
+		results.push_back(measure(direct, snapshot, threadPool));
+		results.back().parameter = "none";
+	}
+
+	for (int c = 0; c < OPENING_CRITERION_COUNT; c++) {
+		OpeningCriterion criterion = static_cast<OpeningCriterion>(c);
+		bool isRelative = criterion == OpeningCriterion::RelativeError;
+		const float* first = isRelative ? std::begin(ERROR_TOLERANCES) : std::begin(OPENING_ANGLES);
+		const float* last = isRelative ? std::end(ERROR_TOLERANCES) : std::end(OPENING_ANGLES);
+
+		for (const float* value = first; value != last; value++) {
+			OpeningTest openingTest;
+			openingTest.setCriterion(criterion);
+			openingTest.setParameter(criterion, *value);
+
+			TreeForceEngine tree;
+			tree.setOpeningTest(openingTest);
+			results.push_back(measure(tree, snapshot, threadPool));
+			results.back().parameter = getOpeningCriterionName(criterion);
+			results.back().value = *value;
+		}
+	}
+
+	for (int order : FMM_ORDERS) {
+		FmmForceEngine fmm(order);
+		results.push_back(measure(fmm, snapshot, threadPool));
+		results.back().parameter = "Order";
+		results.back().value = static_cast<float>(order);
+	}
+
+	for (int meshSize : MESH_SIZES) {
+		PmForceEngine pm(meshSize);
+		results.push_back(measure(pm, snapshot, threadPool));
+		results.back().parameter = "Mesh size";
+		results.back().value = static_cast<float>(meshSize);
+	}
+
+	for (float openingAngle : OPENING_ANGLES) {
+		TreePmForceEngine treePm;
+		OpeningTest openingTest(openingAngle);
+		treePm.setOpeningTest(openingTest);
+		results.push_back(measure(treePm, snapshot, threadPool));
+		results.back().parameter = getOpeningCriterionName(OpeningCriterion::BarnesHut);
+		results.back().value = openingAngle;
+	}
+}
+
+// A setting is on the front when every faster one has a larger RMS error
+void markParetoFront(std::vector<Result>::iterator first, std::vector<Result>::iterator last)
+{
+	std::vector<Result*> byTime;
+	for (std::vector<Result>::iterator result = first; result != last; result++) {
+		byTime.push_back(&*result);
+	}
+	std::stable_sort(byTime.begin(), byTime.end(), [](const Result* a, const Result* b) { return a->milliseconds < b->milliseconds; });
+
+	bool hasBest = false;
+	float bestError = 0;
+	for (Result* result : byTime) {
+		result->isPareto = !hasBest || result->rmsError < bestError;
+		if (result->isPareto) {
+			bestError = result->rmsError;
+			hasBest = true;
+		}
+	}
+}
+
+};
+
+int runAccuracySweep(const AccuracyOptions& options)
+{
+	int threadCount = options.threadCount > 0 ? options.threadCount : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	ThreadPool threadPool(threadCount);
+	std::mt19937 random(options.seed);
+
+	std::FILE* file = std::fopen(options.outputPath.c_str(), "w");
+	if (file == nullptr) {
+		SDL_Log("Failed to open %s for writing", options.outputPath.c_str());
+		return 1;
+	}
+
+	Snapshot snapshots[2];
+	snapshots[0].name = "disk";
+	snapshots[0].masses = makeDisk(options.bodyCount, random);
+	snapshots[1].name = "clusters";
+	snapshots[1].masses = makeClusters(options.bodyCount, random);
+
+	std::fprintf(file, "scene,engine,parameter,value,milliseconds,rms_error,p99_error,pareto\n");
+
+	for (Snapshot& snapshot : snapshots) {
+		SDL_Log("Accuracy sweep: %s, %d bodies, %d threads", snapshot.name, options.bodyCount, threadCount);
+		computeReference(snapshot, options.sampleSize, threadPool);
+
+		std::vector<Result> results;
+		measureSettings(snapshot, threadPool, results);
+		markParetoFront(results.begin(), results.end());
+
+		for (const Result& result : results) {
+			std::fprintf(file, "%s,%s,%s,%g,%.3f,%.3e,%.3e,%d\n", result.scene, result.engine, result.parameter, result.value,
+				result.milliseconds, result.rmsError, result.p99Error, result.isPareto ? 1 : 0);
+
+			if (result.isPareto)
+				SDL_Log("  %-16s %-14s %-8g %10.3f ms  RMS %.2e  p99 %.2e", result.engine, result.parameter, result.value, result.milliseconds, result.rmsError, result.p99Error);
+		}
+	}
+
+	bool isWritten = std::fclose(file) == 0;
+	if (!isWritten)
+		SDL_Log("Failed to write %s", options.outputPath.c_str());
+
+	return isWritten ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+struct AccuracyOptions {
+	std::string outputPath; // CSV with one row per engine setting and scene
+	int bodyCount = 65536;
+	int sampleSize = 1024; // Bodies whose accelerations are checked against direct summation
+	int threadCount = 0; // Zero uses every hardware thread
+	unsigned seed = 1;
+};
+
+// Runs each approximate engine over a range of its accuracy parameter, on the
+// same generated snapshots, and measures it against direct summation: the
+// RMS and 99th percentile of |a - a_direct| / |a_direct| over a sample of
+// bodies, and the best time per step. Settings that no faster setting beats
+// on RMS error are marked as the scene's Pareto front. Returns the process
+// exit status.
+int runAccuracySweep(const AccuracyOptions&);
@@ -0,0 +1,124 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "AllocationTracker.h"
+
+// Local state and functions
+namespace {
+
+	std::atomic<std::uint64_t> totalAllocations(0);
+	thread_local std::uint64_t threadAllocations = 0;
+
+	void countAllocation()
+	{
+#ifdef GRAVITY_TRACK_ALLOCATIONS
+		threadAllocations++;
+		totalAllocations.fetch_add(1, std::memory_order_relaxed);
+#endif
+	}
+
+#ifdef GRAVITY_TRACK_ALLOCATIONS
+	void* allocate(std::size_t size)
+	{
+		countAllocation();
+
+		void* pointer = std::malloc(size != 0 ? size : 1);
+		if (pointer == nullptr)
+			throw std::bad_alloc();
+
+		return pointer;
+	}
+#endif
+
+	void* allocateNoThrow(std::size_t size) noexcept
+	{
+		countAllocation();
+
+		return std::malloc(size != 0 ? size : 1);
+	}
+
+};
+
+bool isAllocationTrackingEnabled()
+{
+#ifdef GRAVITY_TRACK_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+std::uint64_t getThreadAllocationCount()
+{
+	return threadAllocations;
+}
+
+std::uint64_t getTotalAllocationCount()
+{
+	return totalAllocations.load(std::memory_order_relaxed);
+}
+
+void* allocateTracked(std::size_t size, void*)
+{
+	return allocateNoThrow(size);
+}
+
+void freeTracked(void* pointer, void*)
+{
+	std::free(pointer);
+}
+
+#ifdef GRAVITY_TRACK_ALLOCATIONS
+
+void* operator new(std::size_t size)
+{
+	return allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+	return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return allocateNoThrow(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return allocateNoThrow(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+	std::free(pointer);
+}
+
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Debug heap tracker. In builds with GRAVITY_TRACK_ALLOCATIONS (on by default
+// unless NDEBUG is set), the global operator new is replaced with a version
+// that counts every allocation per thread, so the profiler can show which
+// phases of a frame touch the heap.
+
+#if !defined(NDEBUG) && !defined(GRAVITY_TRACK_ALLOCATIONS)
+#define GRAVITY_TRACK_ALLOCATIONS
+#endif
+
+bool isAllocationTrackingEnabled();
+
+std::uint64_t getThreadAllocationCount();
+std::uint64_t getTotalAllocationCount();
+
+// Counting allocator for ImGui::SetAllocatorFunctions
+void* allocateTracked(std::size_t size, void* userData);
+void freeTracked(void* pointer, void* userData);
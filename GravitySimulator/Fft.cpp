@@ -0,0 +1,90 @@
+#include <cmath>
+
+#include "Fft.h"
+
+FftPlan::FftPlan(int size) : m_size(size)
+{
+	int bits = 0;
+	while ((1 << bits) < size) {
+		bits++;
+	}
+
+	m_bitReversal.resize(size);
+	for (int i = 0; i < size; i++) {
+		int reversed = 0;
+		for (int b = 0; b < bits; b++) {
+			if (i & (1 << b))
+				reversed |= 1 << (bits - 1 - b);
+		}
+		m_bitReversal[i] = reversed;
+	}
+
+	m_twiddles.resize(size / 2);
+	for (int k = 0; k < size / 2; k++) {
+		double angle = -2 * M_PI * k / size;
+		m_twiddles[k] = std::complex<float>(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+	}
+}
+
+int FftPlan::size() const
+{
+	return m_size;
+}
+
+void FftPlan::transform(std::complex<float>* data, bool isInverse) const
+{
+	for (int i = 0; i < m_size; i++) {
+		int j = m_bitReversal[i];
+		if (i < j)
+			std::swap(data[i], data[j]);
+	}
+
+	for (int length = 2; length <= m_size; length *= 2) {
+		int half = length / 2;
+		int twiddleStride = m_size / length;
+
+		for (int start = 0; start < m_size; start += length) {
+			for (int k = 0; k < half; k++) {
+				std::complex<float> twiddle = m_twiddles[k * twiddleStride];
+				if (isInverse)
+					twiddle = std::conj(twiddle);
+
+				std::complex<float> even = data[start + k];
+				std::complex<float> odd = data[start + k + half] * twiddle;
+				data[start + k] = even + odd;
+				data[start + k + half] = even - odd;
+			}
+		}
+	}
+}
+
+void FftPlan::transform2d(std::complex<float>* data, bool isInverse, ThreadPool& threadPool) const
+{
+	int size = m_size;
+
+	threadPool.parallelFor(size, 1, [&](int begin, int end) {
+		for (int row = begin; row < end; row++) {
+			transform(data + static_cast<std::size_t>(row) * size, isInverse);
+		}
+	});
+
+	// Columns are gathered into a contiguous line, kept per thread so steady
+	// state transforms do not allocate
+	threadPool.parallelFor(size, 1, [&](int begin, int end) {
+		thread_local std::vector<std::complex<float>> scratch;
+		scratch.resize(size);
+		std::complex<float>* line = scratch.data();
+
+		for (int column = begin; column < end; column++) {
+			for (int row = 0; row < size; row++) {
+				line[row] = data[static_cast<std::size_t>(row) * size + column];
+			}
+
+			transform(line, isInverse);
+
+			for (int row = 0; row < size; row++) {
+				data[static_cast<std::size_t>(row) * size + column] = line[row];
+			}
+		}
+	});
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Iterative radix-2 fast Fourier transform of a fixed power-of-two size.
+// The inverse transform is unnormalized, so a round trip scales by size.
+class FftPlan {
+public:
+	explicit FftPlan(int size = 1);
+
+	int size() const;
+
+	void transform(std::complex<float>* data, bool isInverse) const;
+
+	// Transforms a size x size row-major grid, rows then columns, one row or
+	// column per task
+	void transform2d(std::complex<float>* data, bool isInverse, ThreadPool&) const;
+
+private:
+	int m_size;
+	std::vector<int> m_bitReversal;
+	std::vector<std::complex<float>> m_twiddles; // exp(-2 pi i k / size) for k < size / 2
+};
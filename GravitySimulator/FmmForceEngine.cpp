@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <cmath>
+
+#include "FmmForceEngine.h"
+#include "Profiler.h"
+
+// Global Constants
+namespace {
+
+	const int GRAIN_SIZE = 16; // Cells per parallel task
+	const int MIN_ORDER = 2;
+	const int MAX_ORDER = 30;
+
+	// Cells are well separated when the sum of their radii is below this
+	// fraction of the distance between their centers
+	const double SEPARATION = 0.5;
+
+};
+
+FmmForceEngine::FmmForceEngine(int order) : m_rebuildInterval(1), m_order(0)
+{
+	setOrder(order);
+}
+
+const char* FmmForceEngine::name() const
+{
+	return "Fast multipole";
+}
+
+int FmmForceEngine::order() const
+{
+	return m_order;
+}
+
+void FmmForceEngine::setOrder(int order)
+{
+	order = std::min(std::max(order, MIN_ORDER), MAX_ORDER);
+	if (order == m_order)
+		return;
+
+	m_order = order;
+
+	int size = 2 * order + 1;
+	m_binomials.assign(size * size, 0.0);
+	for (int n = 0; n < size; n++) {
+		m_binomials[n * size] = 1;
+		for (int k = 1; k <= n; k++) {
+			m_binomials[n * size + k] = m_binomials[(n - 1) * size + k - 1] + (k < n ? m_binomials[(n - 1) * size + k] : 0.0);
+		}
+	}
+}
+
+void FmmForceEngine::resetCaches()
+{
+	m_tree.invalidate();
+}
+
+int FmmForceEngine::rebuildInterval() const
+{
+	return m_rebuildInterval;
+}
+
+void FmmForceEngine::setRebuildInterval(int rebuildInterval)
+{
+	m_rebuildInterval = std::max(rebuildInterval, 1);
+}
+
+double FmmForceEngine::binomial(int n, int k) const
+{
+	return m_binomials[n * (2 * m_order + 1) + k];
+}
+
+void FmmForceEngine::computeAccelerations(std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	{
+		PROFILE_SCOPE("Build tree");
+		m_tree.update(masses, threadPool, m_rebuildInterval);
+	}
+
+	if (masses.empty())
+		return;
+
+	{
+		PROFILE_SCOPE("Upward pass");
+		upwardPass(masses);
+	}
+
+	{
+		PROFILE_SCOPE("Dual-tree traversal");
+		traverse();
+		groupPairs(m_farPairs, m_farStart, m_farSources);
+		groupPairs(m_nearPairs, m_nearStart, m_nearSources);
+	}
+
+	{
+		PROFILE_SCOPE("Multipole to local");
+		convertMultipoles(threadPool);
+	}
+
+	{
+		PROFILE_SCOPE("Downward pass");
+		downwardPass();
+	}
+
+	{
+		PROFILE_SCOPE("Evaluate");
+		evaluate(masses, threadPool);
+	}
+}
+
+// Children always follow their parent in the node array, so walking it
+// backward visits every child before its parent
+void FmmForceEngine::upwardPass(const std::vector<Mass>& masses)
+{
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+	const std::vector<int>& bodies = m_tree.bodies();
+	int terms = m_order + 1;
+
+	m_multipoles.assign(nodes.size() * terms, Complex(0, 0));
+	m_radii.assign(nodes.size(), 0.0);
+
+	for (int n = static_cast<int>(nodes.size()) - 1; n >= 0; n--) {
+		const QuadTreeNode& node = nodes[n];
+		Complex center(node.center.x, node.center.y);
+		Complex* multipole = &m_multipoles[n * terms];
+
+		if (node.firstChild == -1) {
+			// Bodies to multipole
+			for (int b = node.firstBody; b < node.firstBody + node.bodyCount; b++) {
+				const Mass& mass = masses[bodies[b]];
+				Complex offset = Complex(mass.position.x, mass.position.y) - center;
+				m_radii[n] = std::max(m_radii[n], std::abs(offset));
+
+				if (mass.doIgnore)
+					continue;
+
+				double charge = GRAVITATIONAL_CONSTANT * static_cast<double>(mass.mass);
+				multipole[0] += charge;
+
+				Complex power = offset;
+				for (int k = 1; k <= m_order; k++) {
+					multipole[k] -= charge * power / static_cast<double>(k);
+					power *= offset;
+				}
+			}
+			continue;
+		}
+
+		// Children's multipoles shifted to this center
+		for (int quadrant = 0; quadrant < 4; quadrant++) {
+			int c = node.firstChild + quadrant;
+			if (nodes[c].bodyCount == 0)
+				continue;
+
+			const Complex* child = &m_multipoles[c * terms];
+			Complex shift = Complex(nodes[c].center.x, nodes[c].center.y) - center;
+			m_radii[n] = std::max(m_radii[n], std::abs(shift) + m_radii[c]);
+
+			multipole[0] += child[0];
+
+			Complex shiftPower = 1; // shift^l
+			for (int l = 1; l <= m_order; l++) {
+				shiftPower *= shift;
+
+				Complex sum = -child[0] * shiftPower / static_cast<double>(l);
+				Complex power = 1; // shift^(l - k)
+				for (int k = l; k >= 1; k--) {
+					sum += child[k] * power * binomial(l - 1, k - 1);
+					power *= shift;
+				}
+				multipole[l] += sum;
+			}
+		}
+	}
+}
+
+// Pairs every target cell with source cells, splitting the larger of two
+// cells until they are well separated or both are leaves. The traversal is
+// serial so the lists, and so the order of every sum, are fixed.
+void FmmForceEngine::traverse()
+{
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+
+	m_farPairs.clear();
+	m_nearPairs.clear();
+	m_stack.clear();
+	m_stack.push_back({ 0, 0 });
+
+	while (!m_stack.empty()) {
+		CellPair pair = m_stack.back();
+		m_stack.pop_back();
+
+		const QuadTreeNode& target = nodes[pair.target];
+		const QuadTreeNode& source = nodes[pair.source];
+
+		if (target.bodyCount == 0 || source.mass == 0)
+			continue;
+
+		double dx = static_cast<double>(target.center.x) - source.center.x;
+		double dy = static_cast<double>(target.center.y) - source.center.y;
+		double radii = m_radii[pair.target] + m_radii[pair.source];
+
+		bool isTargetLeaf = target.firstChild == -1;
+		bool isSourceLeaf = source.firstChild == -1;
+
+		if (pair.target != pair.source && radii * radii < SEPARATION * SEPARATION * (dx * dx + dy * dy)) {
+			m_farPairs.push_back(pair);
+		}
+		else if (isTargetLeaf && isSourceLeaf) {
+			m_nearPairs.push_back(pair);
+		}
+		else if (isSourceLeaf || (!isTargetLeaf && m_radii[pair.target] >= m_radii[pair.source])) {
+			for (int quadrant = 3; quadrant >= 0; quadrant--) {
+				m_stack.push_back({ target.firstChild + quadrant, pair.source });
+			}
+		}
+		else {
+			for (int quadrant = 3; quadrant >= 0; quadrant--) {
+				m_stack.push_back({ pair.target, source.firstChild + quadrant });
+			}
+		}
+	}
+}
+
+// Counting sort by target, which keeps each target's sources in traversal order
+void FmmForceEngine::groupPairs(const std::vector<CellPair>& pairs, std::vector<int>& start, std::vector<int>& sources)
+{
+	start.assign(m_tree.nodes().size() + 1, 0);
+	for (const CellPair& pair : pairs) {
+		start[pair.target + 1]++;
+	}
+	for (int n = 1; n < start.size(); n++) {
+		start[n] += start[n - 1];
+	}
+
+	sources.resize(pairs.size());
+	m_cursors.assign(start.begin(), start.end() - 1);
+	for (const CellPair& pair : pairs) {
+		sources[m_cursors[pair.target]++] = pair.source;
+	}
+}
+
+void FmmForceEngine::convertMultipoles(ThreadPool& threadPool)
+{
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+	int terms = m_order + 1;
+
+	m_locals.assign(nodes.size() * terms, Complex(0, 0));
+
+	threadPool.parallelFor(static_cast<int>(nodes.size()), GRAIN_SIZE, [&](int begin, int end) {
+		// The constant term of a local expansion does not affect the field, so
+		// only coefficients 1 to order are formed
+		Complex scaled[MAX_ORDER + 1]; // (-1)^k a_k / z0^k
+
+		for (int n = begin; n < end; n++) {
+			Complex* local = &m_locals[n * terms];
+			Complex center(nodes[n].center.x, nodes[n].center.y);
+
+			for (int f = m_farStart[n]; f < m_farStart[n + 1]; f++) {
+				int s = m_farSources[f];
+				const Complex* multipole = &m_multipoles[s * terms];
+				Complex offset = Complex(nodes[s].center.x, nodes[s].center.y) - center;
+				Complex inverse = 1.0 / offset;
+
+				Complex inversePower = 1;
+				for (int k = 1; k <= m_order; k++) {
+					inversePower *= -inverse;
+					scaled[k] = multipole[k] * inversePower;
+				}
+
+				Complex outer = 1; // 1 / z0^l
+				for (int l = 1; l <= m_order; l++) {
+					outer *= inverse;
+
+					Complex sum = -multipole[0] / static_cast<double>(l);
+					for (int k = 1; k <= m_order; k++) {
+						sum += scaled[k] * binomial(l + k - 1, k - 1);
+					}
+					local[l] += sum * outer;
+				}
+			}
+		}
+	});
+}
+
+// Parents come before their children, so a forward walk pushes every local
+// expansion all the way down
+void FmmForceEngine::downwardPass()
+{
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+	int terms = m_order + 1;
+
+	for (int n = 0; n < nodes.size(); n++) {
+		const QuadTreeNode& node = nodes[n];
+		if (node.firstChild == -1)
+			continue;
+
+		const Complex* parent = &m_locals[n * terms];
+		Complex center(node.center.x, node.center.y);
+
+		for (int quadrant = 0; quadrant < 4; quadrant++) {
+			int c = node.firstChild + quadrant;
+			if (nodes[c].bodyCount == 0)
+				continue;
+
+			Complex* child = &m_locals[c * terms];
+			Complex shift = Complex(nodes[c].center.x, nodes[c].center.y) - center;
+
+			for (int l = 1; l <= m_order; l++) {
+				Complex sum = 0;
+				Complex power = 1; // shift^(k - l)
+				for (int k = l; k <= m_order; k++) {
+					sum += parent[k] * binomial(k, l) * power;
+					power *= shift;
+				}
+				child[l] += sum;
+			}
+		}
+	}
+}
+
+void FmmForceEngine::evaluate(std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+	const std::vector<int>& bodies = m_tree.bodies();
+	int terms = m_order + 1;
+
+	threadPool.parallelFor(static_cast<int>(nodes.size()), GRAIN_SIZE, [&](int begin, int end) {
+		for (int n = begin; n < end; n++) {
+			const QuadTreeNode& node = nodes[n];
+			if (node.firstChild != -1)
+				continue;
+
+			const Complex* local = &m_locals[n * terms];
+			Complex center(node.center.x, node.center.y);
+
+			for (int b = node.firstBody; b < node.firstBody + node.bodyCount; b++) {
+				int i = bodies[b];
+				Complex position(masses[i].position.x, masses[i].position.y);
+
+				// Field of the local expansion: the sum of l b_l w^(l - 1)
+				Complex offset = position - center;
+				Complex field = 0;
+				for (int l = m_order; l >= 1; l--) {
+					field = field * offset + local[l] * static_cast<double>(l);
+				}
+
+				for (int f = m_nearStart[n]; f < m_nearStart[n + 1]; f++) {
+					const QuadTreeNode& source = nodes[m_nearSources[f]];
+
+					for (int s = source.firstBody; s < source.firstBody + source.bodyCount; s++) {
+						const Mass& mass = masses[bodies[s]];
+						if (bodies[s] == i || mass.doIgnore)
+							continue;
+
+						Complex difference = position - Complex(mass.position.x, mass.position.y);
+						field += GRAVITATIONAL_CONSTANT * static_cast<double>(mass.mass) / difference;
+					}
+				}
+
+				// The field is the sum of q / (z - z_source); the pull is its negated conjugate
+				masses[i].acceleration.x = static_cast<float>(-field.real());
+				masses[i].acceleration.y = static_cast<float>(field.imag());
+			}
+		}
+	});
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+#include "ForceEngine.h"
+#include "QuadTree.h"
+
+// Fast multipole method with complex-variable expansions of the logarithmic
+// potential (Greengard and Rokhlin). Cells carry multipole expansions built
+// upward through the quadtree, and a dual-tree traversal pairs well-separated
+// cells, whose multipoles are converted into local expansions of the target.
+// Nearby leaves interact directly. The error falls geometrically with the
+// order of the expansions.
+class FmmForceEngine : public ForceEngine {
+public:
+	explicit FmmForceEngine(int order = 8);
+
+	const char* name() const final;
+
+	void resetCaches() final;
+	void computeAccelerations(std::vector<Mass>&, ThreadPool&) final;
+
+	// Steps between full tree builds. The tree is refit in between, which
+	// is cheaper but loosens its cells as bodies move.
+	int rebuildInterval() const;
+	void setRebuildInterval(int);
+
+	int order() const;
+	void setOrder(int);
+
+private:
+	typedef std::complex<double> Complex;
+
+	struct CellPair {
+		int target;
+		int source;
+	};
+
+	QuadTree m_tree;
+	int m_rebuildInterval;
+	int m_order;
+
+	std::vector<Complex> m_multipoles; // order + 1 coefficients per cell
+	std::vector<Complex> m_locals;
+	std::vector<double> m_radii; // Largest distance from a cell's center to one of its bodies
+
+	// Interaction lists grouped by target cell, in traversal order
+	std::vector<CellPair> m_farPairs; // Multipole to local conversions
+	std::vector<CellPair> m_nearPairs; // Direct sums between leaves
+	std::vector<int> m_farStart;
+	std::vector<int> m_farSources;
+	std::vector<int> m_nearStart;
+	std::vector<int> m_nearSources;
+	std::vector<int> m_cursors;
+	std::vector<CellPair> m_stack;
+
+	std::vector<double> m_binomials; // Pascal's triangle up to 2 * order
+
+	void upwardPass(const std::vector<Mass>&);
+	void traverse();
+	void groupPairs(const std::vector<CellPair>&, std::vector<int>& start, std::vector<int>& sources);
+	void convertMultipoles(ThreadPool&);
+	void downwardPass();
+	void evaluate(std::vector<Mass>&, ThreadPool&);
+
+	double binomial(int n, int k) const;
+};
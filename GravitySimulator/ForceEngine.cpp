@@ -0,0 +1,145 @@
+#include "ForceEngine.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GRAVITY_USE_SSE
+#endif
+
+// Global Constants
+namespace {
+
+	const int GRAIN_SIZE = 64; // Bodies per parallel task
+	const int VECTOR_WIDTH = 4;
+
+};
+
+Vector2 getPointAcceleration(const std::vector<Mass>& masses, float x, float y, int ignoreIndex, const PeriodicDomain& domain)
+{
+	Vector2 result = { 0, 0 };
+	Vector2 r;
+
+	if (domain.isEnabled) {
+		for (int i = 0; i < masses.size(); i++) {
+			if (i != ignoreIndex && !masses[i].doIgnore) {
+				r = getNearestImage(domain, { masses[i].position.x - x, masses[i].position.y - y });
+				result += getPeriodicPull(domain, r, GRAVITATIONAL_CONSTANT * masses[i].mass);
+			}
+		}
+
+		return result;
+	}
+
+	for (int i = 0; i < masses.size(); i++) {
+		if (i != ignoreIndex && !masses[i].doIgnore) {
+			r.x = masses[i].position.x - x;
+			r.y = masses[i].position.y - y;
+			result += r * (GRAVITATIONAL_CONSTANT * masses[i].mass / (getLength(r) * getLength(r)));
+		}
+	}
+
+	return result;
+}
+
+const char* DirectForceEngine::name() const
+{
+	return "Direct";
+}
+
+bool DirectForceEngine::isQuadratic() const
+{
+	return true;
+}
+
+bool DirectForceEngine::supportsPeriodic() const
+{
+	return true;
+}
+
+void DirectForceEngine::computeAccelerations(std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	threadPool.parallelFor(static_cast<int>(masses.size()), GRAIN_SIZE, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			masses[i].acceleration = getPointAcceleration(masses, masses[i].position.x, masses[i].position.y, i, m_domain);
+		}
+	});
+}
+
+const char* SimdForceEngine::name() const
+{
+	return "Direct SIMD";
+}
+
+bool SimdForceEngine::isQuadratic() const
+{
+	return true;
+}
+
+void SimdForceEngine::computeAccelerations(std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	int count = static_cast<int>(masses.size());
+	int paddedCount = (count + VECTOR_WIDTH - 1) / VECTOR_WIDTH * VECTOR_WIDTH;
+
+	m_x.resize(paddedCount);
+	m_y.resize(paddedCount);
+	m_strength.resize(paddedCount);
+
+	for (int i = 0; i < paddedCount; i++) {
+		bool isSource = i < count && !masses[i].doIgnore;
+		m_x[i] = i < count ? masses[i].position.x : 0;
+		m_y[i] = i < count ? masses[i].position.y : 0;
+		m_strength[i] = isSource ? GRAVITATIONAL_CONSTANT * masses[i].mass : 0;
+	}
+
+	const float* xs = m_x.data();
+	const float* ys = m_y.data();
+	const float* strengths = m_strength.data();
+
+	// A body's own term has zero distance and is masked out along with any
+	// coincident body, so no index comparison is needed in the inner loop
+	threadPool.parallelFor(count, GRAIN_SIZE, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			float x = masses[i].position.x;
+			float y = masses[i].position.y;
+
+#ifdef GRAVITY_USE_SSE
+			__m128 targetX = _mm_set1_ps(x);
+			__m128 targetY = _mm_set1_ps(y);
+			__m128 zero = _mm_setzero_ps();
+			__m128 sumX = zero;
+			__m128 sumY = zero;
+
+			for (int j = 0; j < paddedCount; j += VECTOR_WIDTH) {
+				__m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + j), targetX);
+				__m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + j), targetY);
+				__m128 distanceSquared = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+				__m128 scale = _mm_and_ps(_mm_div_ps(_mm_loadu_ps(strengths + j), distanceSquared), _mm_cmpgt_ps(distanceSquared, zero));
+				sumX = _mm_add_ps(sumX, _mm_mul_ps(dx, scale));
+				sumY = _mm_add_ps(sumY, _mm_mul_ps(dy, scale));
+			}
+
+			float lanesX[VECTOR_WIDTH];
+			float lanesY[VECTOR_WIDTH];
+			_mm_storeu_ps(lanesX, sumX);
+			_mm_storeu_ps(lanesY, sumY);
+
+			masses[i].acceleration.x = (lanesX[0] + lanesX[1]) + (lanesX[2] + lanesX[3]);
+			masses[i].acceleration.y = (lanesY[0] + lanesY[1]) + (lanesY[2] + lanesY[3]);
+#else
+			Vector2 sum = { 0, 0 };
+
+			for (int j = 0; j < paddedCount; j++) {
+				float dx = xs[j] - x;
+				float dy = ys[j] - y;
+				float distanceSquared = dx * dx + dy * dy;
+				if (distanceSquared > 0) {
+					float scale = strengths[j] / distanceSquared;
+					sum.x += dx * scale;
+					sum.y += dy * scale;
+				}
+			}
+
+			masses[i].acceleration = sum;
+#endif
+		}
+	});
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+
+#include "Mass.h"
+#include "PeriodicDomain.h"
+#include "ThreadPool.h"
+
+const float GRAVITATIONAL_CONSTANT = 66.7408f; // [km^3 Yg^-1 s^-1]
+
+// Computes the acceleration of every mass from the positions of all of them.
+// Masses waiting for a velocity receive an acceleration but exert no pull.
+class ForceEngine {
+public:
+	virtual ~ForceEngine() {}
+
+	virtual const char* name() const = 0;
+
+	// Engines whose cost grows with the square of the body count are only
+	// benchmarked on small scenes
+	virtual bool isQuadratic() const { return false; }
+
+	// Engines that cannot sum periodic images are not used in a periodic domain
+	virtual bool supportsPeriodic() const { return false; }
+	virtual void setDomain(const PeriodicDomain& domain) { m_domain = domain; }
+
+	// Called when masses are reordered or replaced, so nothing kept from the
+	// previous call is reused
+	virtual void resetCaches() {}
+
+	virtual void computeAccelerations(std::vector<Mass>&, ThreadPool&) = 0;
+
+protected:
+	PeriodicDomain m_domain;
+};
+
+// Sum over every other mass of the pull at (x, y), in index order
+Vector2 getPointAcceleration(const std::vector<Mass>&, float x, float y, int ignoreIndex, const PeriodicDomain& = PeriodicDomain());
+
+// Exact pairwise summation, one body at a time
+class DirectForceEngine : public ForceEngine {
+public:
+	const char* name() const final;
+	bool isQuadratic() const final;
+	bool supportsPeriodic() const final;
+
+	void computeAccelerations(std::vector<Mass>&, ThreadPool&) final;
+};
+
+// Pairwise summation over a structure-of-arrays copy of the masses, four
+// sources at a time with SSE where the target has it
+class SimdForceEngine : public ForceEngine {
+public:
+	const char* name() const final;
+	bool isQuadratic() const final;
+
+	void computeAccelerations(std::vector<Mass>&, ThreadPool&) final;
+
+private:
+	std::vector<float> m_x;
+	std::vector<float> m_y;
+	std::vector<float> m_strength; // G times mass, zero for ignored and padding bodies
+};
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "ForceEngineSelector.h"
+#include "Profiler.h"
+#include "TreeForceEngine.h"
+
+// Global Constants
+namespace {
+
+	const int SAMPLE_SIZE = 256; // Bodies whose accelerations are checked against direct summation
+	const int REFERENCE_GRAIN_SIZE = 16;
+	const int MAX_QUADRATIC_BENCHMARK_BODIES = 8192; // Beyond this a quadratic engine is never the fastest
+	const int BENCHMARK_RUNS = 2; // The faster run is kept, so the first can warm caches
+	const float MAX_REPEATED_MILLISECONDS = 20; // Slower runs are not dominated by warm-up, so one is enough
+
+};
+
+// Local functions
+namespace {
+
+// Index of the highest set bit, so scenes in [2^k, 2^(k+1)) share a bucket
+int getSizeBucket(int bodyCount)
+{
+	int bucket = 0;
+	while (bodyCount > 1) {
+		bodyCount >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+};
+
+ForceEngineSelector::ForceEngineSelector() : m_selectedEngine(0), m_benchmarkBodyCount(-1), m_isInvalid(true), m_referenceNorm(0)
+{
+	m_engines.emplace_back(new DirectForceEngine());
+	m_engines.emplace_back(new SimdForceEngine());
+	m_tree = new TreeForceEngine();
+	m_treeIndex = engineCount();
+	m_engines.emplace_back(m_tree);
+
+	m_fmm = new FmmForceEngine();
+	m_engines.emplace_back(m_fmm);
+
+	m_pm = new PmForceEngine();
+	m_engines.emplace_back(m_pm);
+
+	m_treePm = new TreePmForceEngine();
+	m_engines.emplace_back(m_treePm);
+
+	Measurement unmeasured = { false, 0, 0 };
+	m_measurements.resize(m_engines.size(), unmeasured);
+	std::fill(std::begin(m_criterionMeasurements), std::end(m_criterionMeasurements), unmeasured);
+}
+
+int ForceEngineSelector::engineCount() const
+{
+	return static_cast<int>(m_engines.size());
+}
+
+ForceEngine& ForceEngineSelector::engine(int index)
+{
+	return *m_engines[index];
+}
+
+int ForceEngineSelector::selectedEngine() const
+{
+	return m_selectedEngine;
+}
+
+void ForceEngineSelector::selectEngine(int index)
+{
+	if (index >= 0 && index < engineCount() && isAvailable(index))
+		m_selectedEngine = index;
+}
+
+void ForceEngineSelector::setDomain(const PeriodicDomain& domain)
+{
+	m_domain = domain;
+
+	for (std::unique_ptr<ForceEngine>& engine : m_engines) {
+		engine->setDomain(domain);
+	}
+
+	if (!isAvailable(m_selectedEngine))
+		m_selectedEngine = 0;
+
+	m_isInvalid = true;
+}
+
+const PeriodicDomain& ForceEngineSelector::domain() const
+{
+	return m_domain;
+}
+
+bool ForceEngineSelector::isAvailable(int index) const
+{
+	return !m_domain.isEnabled || m_engines[index]->supportsPeriodic();
+}
+
+bool ForceEngineSelector::needsBenchmark(int bodyCount) const
+{
+	if (bodyCount == 0)
+		return false;
+
+	return m_isInvalid || getSizeBucket(bodyCount) != getSizeBucket(std::max(m_benchmarkBodyCount, 1));
+}
+
+void ForceEngineSelector::invalidate()
+{
+	m_isInvalid = true;
+}
+
+int ForceEngineSelector::benchmark(const std::vector<Mass>& masses, ThreadPool& threadPool, float errorBudget)
+{
+	PROFILE_SCOPE("Benchmark engines");
+
+	int count = static_cast<int>(masses.size());
+	m_benchmarkBodyCount = count;
+	m_isInvalid = false;
+
+	// Reference accelerations for evenly spaced bodies, each a direct sum.
+	// The norm is summed afterwards in a fixed order.
+	int sampleSize = std::min(count, SAMPLE_SIZE);
+	m_sample.resize(sampleSize);
+	m_reference.resize(sampleSize);
+
+	for (int k = 0; k < sampleSize; k++) {
+		m_sample[k] = static_cast<int>(static_cast<long long>(k) * count / sampleSize);
+	}
+
+	threadPool.parallelFor(sampleSize, REFERENCE_GRAIN_SIZE, [&](int begin, int end) {
+		for (int k = begin; k < end; k++) {
+			const Mass& mass = masses[m_sample[k]];
+			m_reference[k] = getPointAcceleration(masses, mass.position.x, mass.position.y, m_sample[k], m_domain);
+		}
+	});
+
+	m_referenceNorm = 0;
+	for (int k = 0; k < sampleSize; k++) {
+		m_referenceNorm += getDotProduct(m_reference[k], m_reference[k]);
+	}
+
+	int best = 0;
+	float bestTime = 0;
+	bool hasBest = false;
+	int mostAccurate = 0;
+
+	for (int e = 0; e < engineCount(); e++) {
+		Measurement& measurement = m_measurements[e];
+		measurement.isMeasured = isAvailable(e) && !(m_engines[e]->isQuadratic() && count > MAX_QUADRATIC_BENCHMARK_BODIES);
+
+		if (!measurement.isMeasured)
+			continue;
+
+		measure(*m_engines[e], masses, threadPool, measurement);
+
+		const Measurement& leader = m_measurements[mostAccurate];
+		if (mostAccurate == e || !leader.isMeasured || std::isnan(leader.error) || measurement.error < leader.error)
+			mostAccurate = e;
+
+		// NaN errors, from coincident bodies, never pass the budget
+		if (measurement.error <= errorBudget && (!hasBest || measurement.milliseconds < bestTime)) {
+			best = e;
+			bestTime = measurement.milliseconds;
+			hasBest = true;
+		}
+	}
+
+	// The tree's current criterion was just measured, the others are tried
+	// in turn and then the test is put back
+	OpeningTest openingTest = m_tree->openingTest();
+	for (int c = 0; c < OPENING_CRITERION_COUNT; c++) {
+		OpeningCriterion criterion = static_cast<OpeningCriterion>(c);
+		m_criterionMeasurements[c] = m_measurements[m_treeIndex];
+
+		if (criterion != openingTest.criterion() && m_criterionMeasurements[c].isMeasured) {
+			OpeningTest trial = openingTest;
+			trial.setCriterion(criterion);
+			m_tree->setOpeningTest(trial);
+			measure(*m_tree, masses, threadPool, m_criterionMeasurements[c]);
+		}
+	}
+	m_tree->setOpeningTest(openingTest);
+
+	// Engines must not refit trees built from the scratch copy
+	resetCaches();
+
+	// With nothing inside the budget, accuracy wins over speed
+	return hasBest ? best : mostAccurate;
+}
+
+// Best of a few runs from scratch, and the RMS error against the reference
+void ForceEngineSelector::measure(ForceEngine& engine, const std::vector<Mass>& masses, ThreadPool& threadPool, Measurement& measurement)
+{
+	measurement.milliseconds = 0;
+
+	for (int run = 0; run < BENCHMARK_RUNS; run++) {
+		m_scratch = masses;
+		engine.resetCaches(); // Time full builds, not refits
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		engine.computeAccelerations(m_scratch, threadPool);
+		float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		if (run == 0 || milliseconds < measurement.milliseconds)
+			measurement.milliseconds = milliseconds;
+
+		if (milliseconds > MAX_REPEATED_MILLISECONDS)
+			break;
+	}
+
+	double errorNorm = 0;
+	for (int k = 0; k < static_cast<int>(m_sample.size()); k++) {
+		Vector2 difference = m_scratch[m_sample[k]].acceleration - m_reference[k];
+		errorNorm += getDotProduct(difference, difference);
+	}
+	measurement.error = m_referenceNorm > 0 ? static_cast<float>(std::sqrt(errorNorm / m_referenceNorm)) : 0.0f;
+}
+
+void ForceEngineSelector::resetCaches()
+{
+	for (std::unique_ptr<ForceEngine>& engine : m_engines) {
+		engine->resetCaches();
+	}
+}
+
+int ForceEngineSelector::treeRebuildInterval() const
+{
+	return m_tree->rebuildInterval();
+}
+
+void ForceEngineSelector::setTreeRebuildInterval(int rebuildInterval)
+{
+	m_tree->setRebuildInterval(rebuildInterval);
+	m_fmm->setRebuildInterval(rebuildInterval);
+	m_treePm->setRebuildInterval(rebuildInterval);
+}
+
+const OpeningTest& ForceEngineSelector::openingTest() const
+{
+	return m_tree->openingTest();
+}
+
+void ForceEngineSelector::setOpeningTest(const OpeningTest& openingTest)
+{
+	m_tree->setOpeningTest(openingTest);
+	m_treePm->setOpeningTest(openingTest);
+}
+
+FmmForceEngine& ForceEngineSelector::fmm()
+{
+	return *m_fmm;
+}
+
+PmForceEngine& ForceEngineSelector::pm()
+{
+	return *m_pm;
+}
+
+TreePmForceEngine& ForceEngineSelector::treePm()
+{
+	return *m_treePm;
+}
+
+const ForceEngineSelector::Measurement& ForceEngineSelector::measurement(int index) const
+{
+	return m_measurements[index];
+}
+
+const ForceEngineSelector::Measurement& ForceEngineSelector::criterionMeasurement(OpeningCriterion criterion) const
+{
+	return m_criterionMeasurements[static_cast<int>(criterion)];
+}
+
+int ForceEngineSelector::benchmarkBodyCount() const
+{
+	return m_benchmarkBodyCount;
+}
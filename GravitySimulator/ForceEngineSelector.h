@@ -0,0 +1,89 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "FmmForceEngine.h"
+#include "ForceEngine.h"
+#include "PmForceEngine.h"
+#include "TreeForceEngine.h"
+#include "TreePmForceEngine.h"
+
+// Owns the candidate force engines and picks between them by timing each on
+// the live scene. The error of each engine is measured against direct
+// summation on a sample of bodies, and the fastest engine within the error
+// budget wins. Scenes are re-measured whenever the body count crosses a power
+// of two, since that is when the best engine tends to change. The Barnes-Hut
+// tree is also measured under every opening criterion, for comparison.
+class ForceEngineSelector {
+public:
+	struct Measurement {
+		bool isMeasured; // Quadratic engines are skipped on large scenes, unavailable ones always
+		float milliseconds;
+		float error; // RMS of |a - a_direct| / RMS of |a_direct|
+	};
+
+	explicit ForceEngineSelector();
+
+	int engineCount() const;
+	ForceEngine& engine(int index);
+
+	int selectedEngine() const;
+	void selectEngine(int index); // Ignored for engines that are not available
+
+	// Passes the domain to every engine. Engines that cannot handle it become
+	// unavailable, and if the selected one is among them, Direct takes over.
+	void setDomain(const PeriodicDomain&);
+	const PeriodicDomain& domain() const;
+	bool isAvailable(int index) const;
+
+	bool needsBenchmark(int bodyCount) const;
+	// Forces the next needsBenchmark to return true
+	void invalidate();
+
+	// Returns the index of the fastest engine within errorBudget. Does not
+	// select it or change the masses, but resets every engine's caches.
+	int benchmark(const std::vector<Mass>&, ThreadPool&, float errorBudget);
+
+	// Forwards to every engine
+	void resetCaches();
+
+	// Steps between full tree builds for every tree-based engine
+	int treeRebuildInterval() const;
+	void setTreeRebuildInterval(int);
+
+	// Opening test for Barnes-Hut and the short-range part of TreePM
+	const OpeningTest& openingTest() const;
+	void setOpeningTest(const OpeningTest&);
+
+	FmmForceEngine& fmm();
+	PmForceEngine& pm();
+	TreePmForceEngine& treePm();
+
+	const Measurement& measurement(int index) const;
+	// The Barnes-Hut tree with each criterion at its current parameter
+	const Measurement& criterionMeasurement(OpeningCriterion) const;
+	int benchmarkBodyCount() const; // -1 before the first benchmark
+
+private:
+	std::vector<std::unique_ptr<ForceEngine>> m_engines;
+	std::vector<Measurement> m_measurements;
+	Measurement m_criterionMeasurements[OPENING_CRITERION_COUNT];
+	TreeForceEngine* m_tree;
+	int m_treeIndex;
+	FmmForceEngine* m_fmm;
+	PmForceEngine* m_pm;
+	TreePmForceEngine* m_treePm;
+	int m_selectedEngine;
+	PeriodicDomain m_domain;
+
+	int m_benchmarkBodyCount;
+	bool m_isInvalid;
+
+	std::vector<Mass> m_scratch; // Engines run on a copy of the scene
+	std::vector<int> m_sample;
+	std::vector<Vector2> m_reference;
+	double m_referenceNorm;
+
+	void measure(ForceEngine&, const std::vector<Mass>&, ThreadPool&, Measurement&);
+};
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+
+#include "FrameArena.h"
+
+// Global Constants
+namespace {
+
+	const std::size_t INITIAL_ARENA_SIZE = 1 << 20;
+
+};
+
+// Local state
+namespace {
+
+	std::mutex arenasMutex;
+	std::vector<FrameArena*> arenas;
+
+	// Arenas register themselves so the main thread can reset and measure them
+	struct RegisteredArena {
+		FrameArena arena;
+
+		RegisteredArena() : arena(INITIAL_ARENA_SIZE)
+		{
+			std::lock_guard<std::mutex> lock(arenasMutex);
+			arenas.push_back(&arena);
+		}
+
+		~RegisteredArena()
+		{
+			std::lock_guard<std::mutex> lock(arenasMutex);
+			arenas.erase(std::find(arenas.begin(), arenas.end(), &arena));
+		}
+	};
+
+};
+
+FrameArena::FrameArena(std::size_t capacity)
+	: m_block(static_cast<unsigned char*>(std::malloc(capacity))), m_capacity(capacity), m_offset(0), m_overflowSize(0), m_frameUsage(0), m_peakUsage(0)
+{
+	if (m_block == nullptr)
+		throw std::bad_alloc();
+}
+
+FrameArena::~FrameArena()
+{
+	reset();
+	std::free(m_block);
+}
+
+void* FrameArena::allocate(std::size_t size, std::size_t alignment)
+{
+	std::size_t start = (m_offset + alignment - 1) & ~(alignment - 1);
+
+	if (start + size <= m_capacity) {
+		m_offset = start + size;
+		return m_block + start;
+	}
+
+	// Out of space: serve this frame from the heap and remember how much was
+	// needed so the next reset can grow the main block
+	void* pointer = std::malloc(size + alignment);
+	if (pointer == nullptr)
+		throw std::bad_alloc();
+
+	m_overflowBlocks.push_back(pointer);
+	m_overflowSize += size + alignment;
+
+	std::size_t address = reinterpret_cast<std::size_t>(pointer);
+	return reinterpret_cast<void*>((address + alignment - 1) & ~(alignment - 1));
+}
+
+FrameArena::Marker FrameArena::mark() const
+{
+	return { m_offset, m_overflowBlocks.size(), m_overflowSize };
+}
+
+void FrameArena::rewind(const Marker& marker)
+{
+	m_frameUsage = std::max(m_frameUsage, usage());
+
+	for (std::size_t i = marker.overflowBlockCount; i < m_overflowBlocks.size(); i++) {
+		std::free(m_overflowBlocks[i]);
+	}
+	m_overflowBlocks.resize(marker.overflowBlockCount);
+
+	m_offset = marker.offset;
+	m_overflowSize = marker.overflowSize;
+}
+
+void FrameArena::reset()
+{
+	m_frameUsage = std::max(m_frameUsage, usage());
+	m_peakUsage = std::max(m_peakUsage, m_frameUsage);
+
+	for (void* pointer : m_overflowBlocks) {
+		std::free(pointer);
+	}
+	m_overflowBlocks.clear();
+
+	// Overflowed this frame, possibly since rewound
+	if (m_frameUsage > m_capacity) {
+		std::size_t capacity = std::max(m_capacity + m_capacity / 2, m_frameUsage);
+		unsigned char* block = static_cast<unsigned char*>(std::malloc(capacity));
+		if (block != nullptr) {
+			std::free(m_block);
+			m_block = block;
+			m_capacity = capacity;
+		}
+	}
+
+	m_offset = 0;
+	m_overflowSize = 0;
+	m_frameUsage = 0;
+}
+
+std::size_t FrameArena::usage() const
+{
+	return m_offset + m_overflowSize;
+}
+
+std::size_t FrameArena::frameUsage() const
+{
+	return std::max(m_frameUsage, usage());
+}
+
+std::size_t FrameArena::peakUsage() const
+{
+	return std::max(m_peakUsage, frameUsage());
+}
+
+FrameArena& getFrameArena()
+{
+	thread_local RegisteredArena registered;
+	return registered.arena;
+}
+
+void resetFrameArenas()
+{
+	std::lock_guard<std::mutex> lock(arenasMutex);
+	for (FrameArena* arena : arenas) {
+		arena->reset();
+	}
+}
+
+std::size_t getFrameArenaUsage()
+{
+	std::lock_guard<std::mutex> lock(arenasMutex);
+
+	std::size_t usage = 0;
+	for (const FrameArena* arena : arenas) {
+		usage += arena->frameUsage();
+	}
+	return usage;
+}
+
+std::size_t getFrameArenaPeakUsage()
+{
+	std::lock_guard<std::mutex> lock(arenasMutex);
+
+	std::size_t usage = 0;
+	for (const FrameArena* arena : arenas) {
+		usage += arena->peakUsage();
+	}
+	return usage;
+}
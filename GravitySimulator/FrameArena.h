@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Linear allocator for data that only lives until the end of the frame. Each
+// thread bumps a pointer through its own arena, and all arenas are rewound at
+// the top of every frame, so allocations have no free cost. An arena that
+// runs out of space chains an overflow block and grows to its peak size at the
+// next reset, so steady-state frames touch the heap zero times.
+class FrameArena {
+public:
+	// Position in the arena, to give back scratch space before the frame ends
+	struct Marker {
+		std::size_t offset;
+		std::size_t overflowBlockCount;
+		std::size_t overflowSize;
+	};
+
+	explicit FrameArena(std::size_t capacity);
+	~FrameArena();
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+
+	// Uninitialized storage for count objects of a trivially destructible type
+	template <typename T>
+	T* allocateArray(std::size_t count)
+	{
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+	}
+
+	// Rewinding invalidates every pointer handed out since the mark, so marks
+	// must be rewound in the reverse order they were made
+	Marker mark() const;
+	void rewind(const Marker&);
+
+	// Invalidates every pointer handed out since the last reset
+	void reset();
+
+	std::size_t usage() const;
+	std::size_t frameUsage() const; // Most used since the last reset, counting rewound space
+	std::size_t peakUsage() const;
+
+private:
+	unsigned char* m_block;
+	std::size_t m_capacity;
+	std::size_t m_offset;
+	std::vector<void*> m_overflowBlocks;
+	std::size_t m_overflowSize;
+	std::size_t m_frameUsage; // Peak since the last reset, which sizes the next block
+	std::size_t m_peakUsage;
+};
+
+// The calling thread's arena, created on first use
+FrameArena& getFrameArena();
+
+// Rewinds every thread's arena; call while no worker is using its arena
+void resetFrameArenas();
+
+// Summed over all threads' arenas. Usage is the most used this frame.
+std::size_t getFrameArenaUsage();
+std::size_t getFrameArenaPeakUsage();
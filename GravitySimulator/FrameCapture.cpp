@@ -0,0 +1,359 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <glad/glad.h>
+
+#include "FrameCapture.h"
+#include "Profiler.h"
+#include "Trace.h"
+
+// Global Constants
+namespace {
+
+	const int PIXEL_BUFFER_COUNT = 3; // Readbacks stay two frames behind rendering
+	const int MAX_QUEUED_FRAMES = 8; // Beyond this the main loop waits for the encoder
+
+};
+
+// Local functions
+namespace {
+
+std::uint32_t updateCrc(std::uint32_t crc, const unsigned char* data, std::size_t size)
+{
+	static std::uint32_t table[256];
+	static bool isTableReady = false;
+
+	if (!isTableReady) {
+		for (std::uint32_t n = 0; n < 256; n++) {
+			std::uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		isTableReady = true;
+	}
+
+	for (std::size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+	return crc;
+}
+
+void appendBigEndian(std::vector<unsigned char>& out, std::uint32_t value)
+{
+	out.push_back(static_cast<unsigned char>(value >> 24));
+	out.push_back(static_cast<unsigned char>(value >> 16));
+	out.push_back(static_cast<unsigned char>(value >> 8));
+	out.push_back(static_cast<unsigned char>(value));
+}
+
+// Appends a chunk's length placeholder and type, returning where it starts
+std::size_t beginChunk(std::vector<unsigned char>& out, const char* type)
+{
+	std::size_t start = out.size();
+	appendBigEndian(out, 0);
+	out.insert(out.end(), type, type + 4);
+	return start;
+}
+
+// Patches in the chunk length and appends its CRC
+void endChunk(std::vector<unsigned char>& out, std::size_t start)
+{
+	std::uint32_t length = static_cast<std::uint32_t>(out.size() - start - 8);
+	out[start] = static_cast<unsigned char>(length >> 24);
+	out[start + 1] = static_cast<unsigned char>(length >> 16);
+	out[start + 2] = static_cast<unsigned char>(length >> 8);
+	out[start + 3] = static_cast<unsigned char>(length);
+
+	std::uint32_t crc = updateCrc(0xFFFFFFFFu, out.data() + start + 4, length + 4) ^ 0xFFFFFFFFu;
+	appendBigEndian(out, crc);
+}
+
+// Writes an RGBA image as a PNG using uncompressed deflate blocks. Capture is
+// meant to be cheap on the encoder thread; recompress offline if size matters.
+// The file is assembled in png, which is reused between frames.
+bool writePng(const char* path, const unsigned char* pixels, int width, int height, std::vector<unsigned char>& png)
+{
+	const std::size_t MAX_BLOCK_SIZE = 65535;
+	const unsigned char SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+	std::size_t rowSize = static_cast<std::size_t>(width) * 4;
+	std::size_t rawSize = (rowSize + 1) * height;
+
+	png.clear();
+	png.reserve(sizeof(SIGNATURE) + rawSize + rawSize / MAX_BLOCK_SIZE * 5 + 64);
+	png.insert(png.end(), SIGNATURE, SIGNATURE + sizeof(SIGNATURE));
+
+	std::size_t header = beginChunk(png, "IHDR");
+	appendBigEndian(png, static_cast<std::uint32_t>(width));
+	appendBigEndian(png, static_cast<std::uint32_t>(height));
+	png.push_back(8); // Bit depth
+	png.push_back(6); // RGBA
+	png.push_back(0);
+	png.push_back(0);
+	png.push_back(0);
+	endChunk(png, header);
+
+	std::size_t data = beginChunk(png, "IDAT");
+	png.push_back(0x78);
+	png.push_back(0x01);
+
+	std::uint32_t adlerA = 1;
+	std::uint32_t adlerB = 0;
+
+	// Scanlines are stored top to bottom, each with a "no filter" byte, and
+	// split across stored blocks wherever they fall
+	std::size_t blockRemaining = 0;
+	std::size_t rawWritten = 0;
+
+	for (int y = height - 1; y >= 0; y--) {
+		const unsigned char* row = pixels + y * rowSize;
+
+		for (std::size_t i = 0; i <= rowSize; i++) {
+			if (blockRemaining == 0) {
+				std::size_t blockSize = std::min(MAX_BLOCK_SIZE, rawSize - rawWritten);
+				bool isFinal = rawWritten + blockSize >= rawSize;
+
+				png.push_back(isFinal ? 1 : 0);
+				png.push_back(static_cast<unsigned char>(blockSize));
+				png.push_back(static_cast<unsigned char>(blockSize >> 8));
+				png.push_back(static_cast<unsigned char>(~blockSize));
+				png.push_back(static_cast<unsigned char>(~blockSize >> 8));
+				blockRemaining = blockSize;
+			}
+
+			unsigned char value = i == 0 ? 0 : row[i - 1];
+			png.push_back(value);
+			adlerA = (adlerA + value) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+
+			blockRemaining--;
+			rawWritten++;
+		}
+	}
+	appendBigEndian(png, (adlerB << 16) | adlerA);
+	endChunk(png, data);
+
+	std::size_t end = beginChunk(png, "IEND");
+	endChunk(png, end);
+
+	PROFILE_SCOPE("Write file");
+
+	std::FILE* file = std::fopen(path, "wb");
+	if (file == nullptr)
+		return false;
+
+	bool isWritten = std::fwrite(png.data(), 1, png.size(), file) == png.size();
+	std::fclose(file);
+
+	return isWritten;
+}
+
+// Writes an RGBA image as a binary PPM, dropping alpha
+bool writePpm(const char* path, const unsigned char* pixels, int width, int height, std::vector<unsigned char>& row)
+{
+	PROFILE_SCOPE("Write file");
+
+	std::FILE* file = std::fopen(path, "wb");
+	if (file == nullptr)
+		return false;
+
+	std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+	row.resize(static_cast<std::size_t>(width) * 3);
+	bool isWritten = true;
+
+	for (int y = height - 1; y >= 0 && isWritten; y--) {
+		const unsigned char* source = pixels + static_cast<std::size_t>(y) * width * 4;
+		for (int x = 0; x < width; x++) {
+			row[3 * x] = source[4 * x];
+			row[3 * x + 1] = source[4 * x + 1];
+			row[3 * x + 2] = source[4 * x + 2];
+		}
+		isWritten = std::fwrite(row.data(), 1, row.size(), file) == row.size();
+	}
+
+	std::fclose(file);
+
+	return isWritten;
+}
+
+};
+
+FrameCapture::FrameCapture(int width, int height, const std::string& directory, CaptureFormat format)
+	: m_width(width), m_height(height), m_directory(directory), m_format(format), m_framesIssued(0), m_framesRead(0), m_queue(MAX_QUEUED_FRAMES), m_queueHead(0), m_queueCount(0), m_isStopping(false)
+{
+	glGenRenderbuffers(1, &m_colorRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_colorRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &m_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorRenderbuffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Capture framebuffer is incomplete", "The requested capture resolution is not supported.", nullptr);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	m_pixelBuffers.resize(PIXEL_BUFFER_COUNT);
+	glGenBuffers(PIXEL_BUFFER_COUNT, m_pixelBuffers.data());
+	for (unsigned pixelBuffer : m_pixelBuffers) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(width) * height * 4, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	m_encoder = std::thread(&FrameCapture::runEncoder, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+	finish();
+
+	glDeleteBuffers(static_cast<int>(m_pixelBuffers.size()), m_pixelBuffers.data());
+	glDeleteFramebuffers(1, &m_framebuffer);
+	glDeleteRenderbuffers(1, &m_colorRenderbuffer);
+}
+
+void FrameCapture::beginFrame(Renderer& renderer)
+{
+	renderer.setRenderTarget(m_framebuffer, m_width, m_height);
+}
+
+void FrameCapture::endFrame(Renderer& renderer, int windowWidth, int windowHeight)
+{
+	// Start an asynchronous readback into the next pixel buffer
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pixelBuffers[m_framesIssued % PIXEL_BUFFER_COUNT]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	m_framesIssued++;
+
+	// Collect the oldest readback once the ring is full; by now the GPU has
+	// had two frames to finish it
+	if (m_framesIssued - m_framesRead >= PIXEL_BUFFER_COUNT) {
+		readBackOldestFrame();
+	}
+
+	// Show the captured frame in the window
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	renderer.resetRenderTarget();
+}
+
+void FrameCapture::finish()
+{
+	if (!m_encoder.joinable())
+		return;
+
+	while (m_framesRead < m_framesIssued) {
+		readBackOldestFrame();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStopping = true;
+	}
+	m_queueChanged.notify_all();
+
+	m_encoder.join();
+}
+
+void FrameCapture::readBackOldestFrame()
+{
+	std::size_t size = static_cast<std::size_t>(m_width) * m_height * 4;
+
+	Frame* frame;
+
+	{
+		PROFILE_SCOPE("Wait for encoder");
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_queueChanged.wait(lock, [this] { return m_queueCount < MAX_QUEUED_FRAMES; });
+
+		// The slot past the tail is invisible to the encoder until it is queued
+		frame = &m_queue[(m_queueHead + m_queueCount) % MAX_QUEUED_FRAMES];
+	}
+
+	// Slots keep their pixel storage, so only the first few frames allocate
+	frame->index = m_framesRead;
+	frame->pixels.resize(size);
+
+	PROFILE_SCOPE("Read back frame");
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pixelBuffers[m_framesRead % PIXEL_BUFFER_COUNT]);
+	void* mapped = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	if (mapped != nullptr) {
+		std::memcpy(frame->pixels.data(), mapped, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	m_framesRead++;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queueCount++;
+	}
+	m_queueChanged.notify_all();
+}
+
+void FrameCapture::runEncoder()
+{
+	setTraceThreadName("Capture encoder");
+
+	// Owned by this thread and reused for every frame
+	std::vector<unsigned char> encodeBuffer;
+
+	while (true) {
+		Frame* frame;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_queueChanged.wait(lock, [this] { return m_queueCount > 0 || m_isStopping; });
+
+			if (m_queueCount == 0)
+				return;
+
+			frame = &m_queue[m_queueHead];
+		}
+
+		writeFrame(*frame, encodeBuffer);
+
+		// Release the slot only once its pixels have been written
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_queueHead = (m_queueHead + 1) % MAX_QUEUED_FRAMES;
+			m_queueCount--;
+		}
+		m_queueChanged.notify_all();
+	}
+}
+
+void FrameCapture::writeFrame(const Frame& frame, std::vector<unsigned char>& encodeBuffer)
+{
+	PROFILE_SCOPE("Encode frame");
+
+	char path[1024];
+	bool isWritten;
+
+	if (m_format == CaptureFormat::Png) {
+		std::snprintf(path, sizeof(path), "%s/frame_%06d.png", m_directory.c_str(), frame.index);
+		isWritten = writePng(path, frame.pixels.data(), m_width, m_height, encodeBuffer);
+	}
+	else {
+		std::snprintf(path, sizeof(path), "%s/frame_%06d.ppm", m_directory.c_str(), frame.index);
+		isWritten = writePpm(path, frame.pixels.data(), m_width, m_height, encodeBuffer);
+	}
+
+	if (!isWritten) {
+		SDL_Log("Failed to write captured frame %s", path);
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Renderer.h"
+
+enum class CaptureFormat {
+	Png,
+	Raw, // Binary PPM
+};
+
+// Renders frames into an offscreen framebuffer of a fixed resolution and
+// writes them to numbered image files. Pixels are read back through a ring of
+// pixel buffer objects and encoded on a worker thread, so the main loop never
+// waits on glReadPixels or on the disk.
+class FrameCapture {
+public:
+	explicit FrameCapture(int width, int height, const std::string& directory, CaptureFormat);
+	~FrameCapture();
+
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	void beginFrame(Renderer&);
+	void endFrame(Renderer&, int windowWidth, int windowHeight);
+
+	// Drains the pixel buffer ring and waits for the encoder to finish
+	void finish();
+
+private:
+	struct Frame {
+		std::vector<unsigned char> pixels;
+		int index;
+	};
+
+	int m_width;
+	int m_height;
+	std::string m_directory;
+	CaptureFormat m_format;
+
+	unsigned m_framebuffer;
+	unsigned m_colorRenderbuffer;
+
+	std::vector<unsigned> m_pixelBuffers;
+	int m_framesIssued;
+	int m_framesRead;
+
+	std::thread m_encoder;
+	std::mutex m_mutex;
+	std::condition_variable m_queueChanged;
+	std::vector<Frame> m_queue; // Fixed ring of MAX_QUEUED_FRAMES slots
+	int m_queueHead;
+	int m_queueCount;
+	bool m_isStopping;
+
+	void readBackOldestFrame();
+	void runEncoder();
+	void writeFrame(const Frame&, std::vector<unsigned char>& encodeBuffer);
+};
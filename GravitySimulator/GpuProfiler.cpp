@@ -0,0 +1,107 @@
+#include <glad/glad.h>
+
+#include "GpuProfiler.h"
+#include "Profiler.h"
+
+// Global Constants
+namespace {
+
+	const int MAX_GPU_SCOPES = 16;
+	const int QUERY_LATENCY = 4; // Frames a result may take before its query is reused
+
+};
+
+// Local state
+namespace {
+
+	struct GpuScope {
+		int profileScope;
+		unsigned queries[QUERY_LATENCY];
+		bool isPending[QUERY_LATENCY];
+		int next; // Query used by the next begin
+		bool isActive; // Whether the current begin issued a query
+	};
+
+	GpuScope gpuScopes[MAX_GPU_SCOPES];
+	int gpuScopeCount = 0;
+
+};
+
+int registerGpuProfileScope(const char* name)
+{
+	if (gpuScopeCount == MAX_GPU_SCOPES)
+		return -1;
+
+	GpuScope& scope = gpuScopes[gpuScopeCount];
+	scope.profileScope = registerProfileScope(name);
+	glGenQueries(QUERY_LATENCY, scope.queries);
+	for (int i = 0; i < QUERY_LATENCY; i++) {
+		scope.isPending[i] = false;
+	}
+	scope.next = 0;
+	scope.isActive = false;
+
+	return gpuScopeCount++;
+}
+
+void beginGpuProfileScope(int index)
+{
+	if (index < 0)
+		return;
+
+	GpuScope& scope = gpuScopes[index];
+	unsigned query = scope.queries[scope.next];
+
+	// Collect the result this query produced QUERY_LATENCY frames ago
+	if (scope.isPending[scope.next]) {
+		int isAvailable = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+
+		if (!isAvailable) {
+			// The GPU is still behind; skip this sample rather than wait
+			skipProfileScopeFrame(scope.profileScope);
+			scope.isActive = false;
+			return;
+		}
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		addProfileScopeTime(scope.profileScope, static_cast<double>(elapsed) * 1e-9);
+		scope.isPending[scope.next] = false;
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, query);
+	scope.isActive = true;
+}
+
+void endGpuProfileScope(int index)
+{
+	if (index < 0)
+		return;
+
+	GpuScope& scope = gpuScopes[index];
+
+	if (scope.isActive) {
+		glEndQuery(GL_TIME_ELAPSED);
+		scope.isPending[scope.next] = true;
+		scope.next = (scope.next + 1) % QUERY_LATENCY;
+		scope.isActive = false;
+	}
+}
+
+void deleteGpuProfileQueries()
+{
+	for (int i = 0; i < gpuScopeCount; i++) {
+		glDeleteQueries(QUERY_LATENCY, gpuScopes[i].queries);
+	}
+}
+
+GpuProfileScope::GpuProfileScope(int scope) : m_scope(scope)
+{
+	beginGpuProfileScope(scope);
+}
+
+GpuProfileScope::~GpuProfileScope()
+{
+	endGpuProfileScope(m_scope);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// GPU-side timing for the frame profiler. Each scope wraps its GL commands in
+// a GL_TIME_ELAPSED query and reports into the profiler scope of the same
+// name once the result is available, a few frames later, so reading results
+// never stalls the pipeline. Scopes must not nest, since only one elapsed-time
+// query can be active at once.
+
+int registerGpuProfileScope(const char* name);
+
+void beginGpuProfileScope(int scope);
+void endGpuProfileScope(int scope);
+
+// Releases the query objects; call before the GL context is destroyed
+void deleteGpuProfileQueries();
+
+class GpuProfileScope {
+public:
+	explicit GpuProfileScope(int scope);
+	~GpuProfileScope();
+
+	GpuProfileScope(const GpuProfileScope&) = delete;
+	GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+private:
+	int m_scope;
+};
+
+#define GPU_PROFILE_CONCATENATE_INNER(a, b) a##b
+#define GPU_PROFILE_CONCATENATE(a, b) GPU_PROFILE_CONCATENATE_INNER(a, b)
+
+// Times the GL commands in the rest of the enclosing block under `name`
+#define GPU_PROFILE_SCOPE(name) \
+	static const int GPU_PROFILE_CONCATENATE(gpuProfileScopeId, __LINE__) = registerGpuProfileScope(name); \
+	GpuProfileScope GPU_PROFILE_CONCATENATE(gpuProfileScope, __LINE__)(GPU_PROFILE_CONCATENATE(gpuProfileScopeId, __LINE__))
@@ -1,8 +1,9 @@
 
+#include <algorithm>
 #include <cmath>
-
-#include <sstream>
-#include <string>
+#include <cstdio>
+#include <cstring>
+#include <thread>
 
 #include <glad/glad.h>
 
@@ -11,47 +12,177 @@
 #include "Vector2.h"
 #include "Mass.h"
 
+#include "FrameArena.h"
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include "Random.h"
+
 #include "GravitySimulator.h"
 
 // Global Constants
 namespace {
 
-	const ImVec4 ORANGE[3] = {
-		{1.0f, 0.4f, 0.0f, 1.0f},
-		{1.0f, 0.6f, 0.0f, 1.0f},
-		{1.0f, 0.8f, 0.0f, 1.0f},
-	};
+	const float FIXED_TIME_STEP = 1.0f / 60.0f; // [s]
+	const unsigned CHECKSUM_INTERVAL = 60; // Steps between state hashes in a recorded log
+	const int REFERENCE_GRAIN_SIZE = 16; // Bodies per parallel task of a direct sum
 
-	const ImVec4 YELLOW[3] = {
-		{1.0f, 1.0f, 0.0f, 1.0f},
-		{1.0f, 1.0f, 0.6f, 1.0f},
-		{1.0f, 1.0f, 0.8f, 1.0f},
-	};
+};
 
-	const ImVec4 GREEN[3] = {
-		{0.0f, 0.8f, 0.0f, 1.0f},
-		{0.0f, 1.0f, 0.2f, 1.0f},
-		{0.4f, 1.0f, 0.4f, 1.0f},
+// Local functions
+namespace {
+
+// Mesh sizes are powers of two from 16, so their slider picks the exponent
+int getMeshLevel(int meshSize)
+{
+	int level = 0;
+	while ((16 << level) < meshSize) {
+		level++;
+	}
+	return level;
+}
+
+// FNV-1a over the bits of every mass's state
+std::uint64_t hashMasses(const std::vector<Mass>& masses)
+{
+	std::uint64_t hash = 14695981039346656037ull;
+
+	auto add = [&](float value) {
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		for (int i = 0; i < 4; i++) {
+			hash ^= (bits >> (8 * i)) & 0xFF;
+			hash *= 1099511628211ull;
+		}
 	};
 
+	for (const Mass& mass : masses) {
+		add(mass.position.x);
+		add(mass.position.y);
+		add(mass.velocity.x);
+		add(mass.velocity.y);
+		add(mass.mass);
+	}
+
+	return hash;
+}
+
 };
 
-GravitySimulator::GravitySimulator() : m_nextMassColor(ORANGE), m_isWaitingForVelocity(false), m_newMassMass(100), m_doCircularOrbit(false)
+GravitySimulator::GravitySimulator(const SimulationOptions& options)
+	: m_sortInterval(16), m_threadPool(options.threadCount > 0 ? options.threadCount : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1)),
+	m_forceEngineMode(-1), m_forceErrorBudget(1e-2f), m_random(options.seed), m_timeStep(0), m_isReplaying(false), m_massColorFilter(-1), m_nextColorIndex(0), m_isWaitingForVelocity(false), m_doCircularOrbit(false), m_newMassMass(100), m_renderMode(RenderMode::Circles), m_heatmapExposure(100.0f),
+	m_doDrawTrails(false), m_trailLength(256), m_trailInterval(4), m_trailMemoryLimit(256), m_stepCount(0), m_scatterCount(1000), m_boxSize(720),
+	m_openingParameter(m_forceEngines.openingTest().parameter(m_forceEngines.openingTest().criterion())), m_fmmOrder(m_forceEngines.fmm().order()), m_meshLevel(getMeshLevel(m_forceEngines.pm().meshSize()))
 {
-	m_masses.reserve(50);
+	reserveMasses(50);
+
+	if (!options.replayPath.empty() && m_inputLog.load(options.replayPath)) {
+		m_timeStep = m_inputLog.timeStep();
+		m_random.seed(m_inputLog.seed());
+		m_isReplaying = true;
+	}
+	else if (options.isDeterministic || !options.recordPath.empty()) {
+		m_timeStep = FIXED_TIME_STEP;
+	}
+
+	if (!options.recordPath.empty()) {
+		m_inputLog.startRecording(options.recordPath, m_timeStep, options.seed);
+	}
 }
 
 void GravitySimulator::update(Renderer& renderer)
 {
-	for (int i = 0; i < m_masses.size(); i++) {
-		m_masses[i].acceleration = getAcceleration(m_masses[i].position.x, m_masses[i].position.y, i);
-		applyAcceleration(m_masses[i], 1.0f / renderer.frameRate());
+	if (m_isReplaying) {
+		replayInputs(renderer);
+	}
+
+	float timeStep = m_timeStep > 0 ? m_timeStep : 1.0f / renderer.frameRate();
+
+	// The choice depends on timing, so it is submitted as an input and a
+	// replay uses the recorded choice instead of measuring
+	if (!m_isReplaying && m_forceEngineMode == -1 && m_forceEngines.needsBenchmark(static_cast<int>(m_masses.size()))) {
+		// Logged even when unchanged, since benchmarking resets the
+		// engines' caches and a replay must reset them at the same step
+		InputEvent event = {};
+		event.type = InputType::SelectForceEngine;
+		event.count = m_forceEngines.benchmark(m_masses, m_threadPool, m_forceErrorBudget);
+		submitInput(renderer, event);
+	}
+
+	// Every acceleration is evaluated from the same positions before any mass
+	// moves. Each body's sum runs on one thread in a fixed order, so results
+	// do not depend on the thread count.
+	{
+		PROFILE_SCOPE("Forces");
+		m_forceEngines.engine(m_forceEngines.selectedEngine()).computeAccelerations(m_masses, m_threadPool);
 	}
+
+	{
+		PROFILE_SCOPE("Integrate");
+		for (Mass& mass : m_masses) {
+			applyAcceleration(mass, timeStep, m_forceEngines.domain());
+		}
+	}
+
+	m_stepCount++;
+
+	// The mass waiting for a velocity must stay last
+	if (m_sortInterval > 0 && m_stepCount % m_sortInterval == 0 && !m_isWaitingForVelocity) {
+		PROFILE_SCOPE("Sort masses");
+		sortMasses();
+	}
+
+	if (m_inputLog.isRecording() && m_stepCount % CHECKSUM_INTERVAL == 0) {
+		InputEvent event = {};
+		event.step = m_stepCount;
+		event.type = InputType::Checksum;
+		event.checksum = hashMasses(m_masses);
+		m_inputLog.record(event);
+	}
+
+	{
+		PROFILE_SCOPE("Trails");
+		updateTrails(renderer);
+	}
+
+	double bodyCount = static_cast<double>(m_masses.size());
+	PROFILE_COUNTER("Bodies", bodyCount);
+	PROFILE_COUNTER("Interactions", bodyCount * std::max(bodyCount - 1, 0.0));
 }
 
 void GravitySimulator::draw(Renderer& renderer)
 {
-	drawMasses(renderer);
+	const PeriodicDomain& domain = m_forceEngines.domain();
+	if (domain.isEnabled) {
+		float left = domain.origin.x;
+		float bottom = domain.origin.y;
+		float right = left + domain.size;
+		float top = bottom + domain.size;
+
+		renderer.setColor(0.4f, 0.4f, 0.4f);
+		renderer.drawLine(left, bottom, right, bottom);
+		renderer.drawLine(right, bottom, right, top);
+		renderer.drawLine(right, top, left, top);
+		renderer.drawLine(left, top, left, bottom);
+	}
+
+	if (m_doDrawTrails) {
+		GPU_PROFILE_SCOPE("GPU Trails");
+		renderer.setColor(0.6f, 0.6f, 0.6f);
+		renderer.drawTrails();
+	}
+
+	switch (m_renderMode) {
+	case RenderMode::Circles:
+		drawMasses(renderer);
+		break;
+	case RenderMode::Particles:
+		drawParticles(renderer);
+		break;
+	case RenderMode::Heatmap:
+		drawHeatmap(renderer);
+		break;
+	}
 }
 
 void GravitySimulator::drawImGui(Renderer& renderer)
@@ -59,94 +190,469 @@ void GravitySimulator::drawImGui(Renderer& renderer)
 
 	drawImGuiExistingMasses(renderer);
 	drawImGuiNewMasses(renderer);
+	drawImGuiDisplay(renderer);
+	drawImGuiForces(renderer);
 	drawImGuiOverlay(renderer);
 }
 
 void GravitySimulator::mousePressed(Renderer& renderer, SDL_MouseButtonEvent e)
 {
 	if (e.type == SDL_MOUSEBUTTONDOWN && e.button == SDL_BUTTON_LEFT) {
-		if (m_isWaitingForVelocity) {
-			m_masses[m_masses.size() - 1].velocity.x = static_cast<float>(e.x) * renderer.scale() - m_masses[m_masses.size() - 1].position.x;
-			m_masses[m_masses.size() - 1].velocity.y = (renderer.height() / renderer.scale() - static_cast<float>(e.y)) * renderer.scale() - m_masses[m_masses.size() - 1].position.y;
-			m_masses[m_masses.size() - 1].doIgnore = false;
+		InputEvent event = {};
+		event.type = InputType::PlaceMass;
+		event.position.x = static_cast<float>(e.x) * renderer.scale();
+		event.position.y = (renderer.height() / renderer.scale() - static_cast<float>(e.y)) * renderer.scale();
+		event.count = e.clicks;
+		submitInput(renderer, event);
+	}
+}
 
-			m_isWaitingForVelocity = false;
+// Runs the engine on a copy of the masses, so it keeps its caches, such as
+// reused interaction lists, but the simulation is not changed
+float GravitySimulator::measureForceError(const std::string& engineName)
+{
+	for (int i = 0; i < m_forceEngines.engineCount(); i++) {
+		ForceEngine& engine = m_forceEngines.engine(i);
+		if (engineName != engine.name() || !m_forceEngines.isAvailable(i))
+			continue;
+
+		std::vector<Mass> masses = m_masses;
+		engine.computeAccelerations(masses, m_threadPool);
+
+		const PeriodicDomain& domain = m_forceEngines.domain();
+		std::vector<float> errors(masses.size(), 0.0f);
+		m_threadPool.parallelFor(static_cast<int>(masses.size()), REFERENCE_GRAIN_SIZE, [&](int begin, int end) {
+			for (int k = begin; k < end; k++) {
+				if (masses[k].doIgnore)
+					continue;
+
+				Vector2 reference = getPointAcceleration(masses, masses[k].position.x, masses[k].position.y, k, domain);
+				if (getLength(reference) > 0)
+					errors[k] = getLength(masses[k].acceleration - reference) / getLength(reference);
+			}
+		});
+
+		double squareSum = 0;
+		for (float error : errors) {
+			squareSum += static_cast<double>(error) * error;
 		}
-		else {
-			Mass newMass;
-			newMass.position.x = static_cast<float>(e.x) * renderer.scale();
-			newMass.position.y = (renderer.height() / renderer.scale() - static_cast<float>(e.y)) * renderer.scale();
-			newMass.velocity.x = 0;
-			newMass.velocity.y = 0;
-			newMass.acceleration.x = 0;
-			newMass.acceleration.y = 0;
-			newMass.mass = m_newMassMass;
+		return masses.empty() ? 0.0f : static_cast<float>(std::sqrt(squareSum / masses.size()));
+	}
+
+	return -1;
+}
+
+// Applies an input from the user and records it, unless a replay is driving the simulation
+void GravitySimulator::submitInput(Renderer& renderer, InputEvent event)
+{
+	if (m_isReplaying)
+		return;
 
-			newMass.color = m_nextMassColor[0];
-			setNextMassColor();
+	event.step = m_stepCount;
+	m_inputLog.record(event);
+	applyInput(renderer, event);
+}
+
+void GravitySimulator::applyInput(Renderer& renderer, const InputEvent& event)
+{
+	switch (event.type) {
+	case InputType::PlaceMass:
+		placeMass(event.position, event.count);
+		break;
+	case InputType::ClearMasses:
+		m_masses.clear();
+		m_forceEngines.resetCaches();
+		m_massIds.clear();
+		m_massIndices.clear();
+		m_isWaitingForVelocity = false;
+		m_doCircularOrbit = false; // There is nothing left to orbit
+		renderer.clearTrails();
+		break;
+	case InputType::SetNewMassMass:
+		m_newMassMass = event.value;
+		break;
+	case InputType::SetCircularOrbit:
+		m_doCircularOrbit = event.count != 0;
+		break;
+	case InputType::ScatterMasses:
+		scatterMasses(event.position, event.count, event.value);
+		break;
+	case InputType::SelectForceEngine:
+		m_forceEngines.selectEngine(event.count);
+		m_forceEngines.resetCaches();
+		break;
+	case InputType::SetFmmOrder:
+		m_forceEngines.fmm().setOrder(event.count);
+		m_forceEngines.invalidate();
+		break;
+	case InputType::SetMeshSize:
+		m_forceEngines.pm().setMeshSize(event.count);
+		m_forceEngines.treePm().mesh().setMeshSize(event.count);
+		m_forceEngines.invalidate();
+		break;
+	case InputType::SetMeshBoundary:
+		m_forceEngines.pm().setBoundary(event.count != 0 ? MeshBoundary::Periodic : MeshBoundary::Isolated);
+		m_forceEngines.invalidate();
+		break;
+	case InputType::SetTreeRebuildInterval:
+		m_forceEngines.setTreeRebuildInterval(event.count);
+		break;
+	case InputType::SetSortInterval:
+		m_sortInterval = std::max(event.count, 0);
+		break;
+	case InputType::SetOpeningCriterion:
+		if (event.count >= 0 && event.count < OPENING_CRITERION_COUNT && event.value > 0) {
+			OpeningTest openingTest = m_forceEngines.openingTest();
+			openingTest.setCriterion(static_cast<OpeningCriterion>(event.count));
+			openingTest.setParameter(openingTest.criterion(), event.value);
+			m_forceEngines.setOpeningTest(openingTest);
+			m_forceEngines.invalidate();
+		}
+		break;
+	case InputType::SetPeriodicDomain:
+		setDomain(renderer, event.count != 0, event.position, event.value);
+		break;
+	case InputType::Checksum:
+		break;
+	}
+}
 
-			if (m_doCircularOrbit) {
-				newMass.doIgnore = false;
-				m_isWaitingForVelocity = false;
+void GravitySimulator::setDomain(Renderer& renderer, bool isPeriodic, Vector2 origin, float size)
+{
+	PeriodicDomain domain;
+	domain.isEnabled = isPeriodic && size > 0;
+	domain.origin = origin;
+	domain.size = size > 0 ? size : 1;
 
-				newMass.acceleration = getAcceleration(newMass.position.x, newMass.position.y, -1);
+	m_forceEngines.setDomain(domain);
 
-				float angle = std::atan2f(newMass.acceleration.y, newMass.acceleration.x) - M_PI / 2;
-				float velocity = std::sqrtf(getLength(newMass.acceleration) * getLength(newMass.position - m_masses[0].position));
+	if (m_forceEngineMode != -1 && !m_forceEngines.isAvailable(m_forceEngineMode))
+		m_forceEngineMode = m_forceEngines.selectedEngine();
 
-				newMass.velocity.x = velocity * std::cosf(angle);
-				newMass.velocity.y = velocity * std::sinf(angle);
-			}
-			else if (e.clicks == 2) {
-				newMass.doIgnore = false;
-				m_isWaitingForVelocity = false;
-			}
-			else {
-				newMass.doIgnore = true;
-				m_isWaitingForVelocity = true;
-			}
+	for (Mass& mass : m_masses) {
+		mass.position = wrapPosition(domain, mass.position);
+	}
 
-			m_masses.push_back(newMass);
+	// Wrapped masses would leave trails across the box
+	renderer.clearTrails();
+}
+
+void GravitySimulator::replayInputs(Renderer& renderer)
+{
+	const InputEvent* event;
+	while ((event = m_inputLog.nextEvent(m_stepCount)) != nullptr) {
+		if (event->type == InputType::Checksum) {
+			if (hashMasses(m_masses) != event->checksum)
+				SDL_Log("Replay diverged from the recording at step %u", m_stepCount);
+		}
+		else {
+			applyInput(renderer, *event);
 		}
 	}
+
+	if (!m_inputLog.isReplaying()) {
+		SDL_Log("Replay finished at step %u", m_stepCount);
+		m_isReplaying = false;
+	}
+}
+
+// Grows every per-mass array at once and geometrically, so adding a mass
+// rarely reallocates and the next sort, which swaps buffers, never does
+void GravitySimulator::reserveMasses(std::size_t count)
+{
+	if (count <= m_masses.capacity())
+		return;
+
+	std::size_t capacity = std::max(count, 2 * m_masses.capacity());
+	m_masses.reserve(capacity);
+	m_massIds.reserve(capacity);
+	m_massIndices.reserve(capacity);
+	m_sortedMasses.reserve(capacity);
+	m_sortedIds.reserve(capacity);
+}
+
+void GravitySimulator::addMass(const Mass& mass)
+{
+	reserveMasses(m_masses.size() + 1);
+
+	m_massIds.push_back(static_cast<int>(m_masses.size()));
+	m_massIndices.push_back(static_cast<int>(m_masses.size()));
+	m_masses.push_back(mass);
+}
+
+// Moves masses into Morton order. Ids follow their masses, so the table and
+// the trails, which are both kept in id order, do not notice.
+void GravitySimulator::sortMasses()
+{
+	const std::vector<int>& order = m_sorter.sort(m_masses, m_threadPool);
+
+	m_sortedMasses.resize(m_masses.size());
+	m_sortedIds.resize(m_masses.size());
+
+	for (int i = 0; i < order.size(); i++) {
+		m_sortedMasses[i] = m_masses[order[i]];
+		m_sortedIds[i] = m_massIds[order[i]];
+		m_massIndices[m_sortedIds[i]] = i;
+	}
+
+	m_masses.swap(m_sortedMasses);
+	m_massIds.swap(m_sortedIds);
+
+	m_forceEngines.resetCaches();
 }
 
-Vector2 GravitySimulator::getAcceleration(float x, float y, int ignoreIndex)
+void GravitySimulator::placeMass(Vector2 position, int clicks)
 {
-	const float G = 66.7408; // [km^3 Yg^-1 s^-1]
+	if (m_isWaitingForVelocity) {
+		m_masses[m_masses.size() - 1].velocity = position - m_masses[m_masses.size() - 1].position;
+		m_masses[m_masses.size() - 1].doIgnore = false;
+
+		m_isWaitingForVelocity = false;
+	}
+	else {
+		const PeriodicDomain& domain = m_forceEngines.domain();
+
+		Mass newMass;
+		newMass.position = wrapPosition(domain, position);
+		newMass.velocity.x = 0;
+		newMass.velocity.y = 0;
+		newMass.acceleration.x = 0;
+		newMass.acceleration.y = 0;
+		newMass.mass = m_newMassMass;
+
+		newMass.colorIndex = m_nextColorIndex;
+		setNextMassColor();
 
-	Vector2 result = { 0, 0 };
-	Vector2 r;
+		// Orbits the first mass placed, so with none it is placed as usual
+		if (m_doCircularOrbit && !m_masses.empty()) {
+			newMass.doIgnore = false;
+			m_isWaitingForVelocity = false;
+
+			newMass.acceleration = getPointAcceleration(m_masses, newMass.position.x, newMass.position.y, -1, domain);
+
+			float angle = std::atan2f(newMass.acceleration.y, newMass.acceleration.x) - M_PI / 2;
+			float velocity = std::sqrtf(getLength(newMass.acceleration) * getLength(getNearestImage(domain, newMass.position - m_masses[m_massIndices[0]].position)));
 
-	for (int i = 0; i < m_masses.size(); i++) {
-		if (i != ignoreIndex && !m_masses[i].doIgnore) {
-			r.x = m_masses[i].position.x - x;
-			r.y = m_masses[i].position.y - y;
-			result += r * (G * m_masses[i].mass / (getLength(r) * getLength(r)));
+			newMass.velocity.x = velocity * std::cosf(angle);
+			newMass.velocity.y = velocity * std::sinf(angle);
+		}
+		else if (clicks == 2) {
+			newMass.doIgnore = false;
+			m_isWaitingForVelocity = false;
 		}
+		else {
+			newMass.doIgnore = true;
+			m_isWaitingForVelocity = true;
+		}
+
+		addMass(newMass);
 	}
+}
 
-	return result;
+// Fills a disk uniformly, with every mass on a circular orbit around the
+// mass enclosed by its radius
+void GravitySimulator::scatterMasses(Vector2 center, int count, float radius)
+{
+	const float MIN_ORBIT_RADIUS = 1; // [km]
+
+	// The mass waiting for a velocity must stay last
+	if (m_isWaitingForVelocity || count <= 0)
+		return;
+
+	float totalMass = count * m_newMassMass;
+	reserveMasses(m_masses.size() + count);
+
+	for (int i = 0; i < count; i++) {
+		float distance = radius * std::sqrt(getRandomUnit(m_random));
+		float angle = 2 * static_cast<float>(M_PI) * getRandomUnit(m_random);
+		float enclosedMass = totalMass * (distance * distance) / (radius * radius);
+		float speed = std::sqrt(GRAVITATIONAL_CONSTANT * enclosedMass / std::max(distance, MIN_ORBIT_RADIUS));
+
+		Mass mass;
+		mass.position.x = center.x + distance * std::cos(angle);
+		mass.position.y = center.y + distance * std::sin(angle);
+		mass.position = wrapPosition(m_forceEngines.domain(), mass.position);
+		mass.velocity.x = -speed * std::sin(angle);
+		mass.velocity.y = speed * std::cos(angle);
+		mass.acceleration.x = 0;
+		mass.acceleration.y = 0;
+		mass.mass = m_newMassMass;
+		mass.doIgnore = false;
+
+		mass.colorIndex = m_nextColorIndex;
+		setNextMassColor();
+
+		addMass(mass);
+	}
 }
 
 void GravitySimulator::drawMasses(Renderer& renderer)
 {
-	for (Mass& mass : m_masses) {
-		drawMass(renderer, mass);
+	const float MARGIN = 5; // Radius of a drawn mass [km]
+
+	Visibility visibility = updateVisibility(renderer, MARGIN);
+
+	// Arrows go underneath every circle
+	{
+		GPU_PROFILE_SCOPE("GPU Vectors");
+		for (int k = 0; k < visibility.massCount; k++) {
+			drawMassVectors(renderer, m_masses[visibility.masses[k]]);
+		}
+	}
+
+	GPU_PROFILE_SCOPE("GPU Circles");
+
+	for (int k = 0; k < visibility.massCount; k++) {
+		drawMass(renderer, m_masses[visibility.masses[k]]);
+	}
+
+	for (int k = 0; k < visibility.nodeCount; k++) {
+		const QuadTreeNode& node = m_spatialIndex.nodes()[visibility.nodes[k]];
+		const ImVec4& color = getMassColor(m_masses[m_spatialIndex.bodies()[node.firstBody]].colorIndex);
+		renderer.setColor(color.x, color.y, color.z);
+		renderer.drawCircle(node.centerOfMass.x, node.centerOfMass.y, MARGIN);
 	}
 }
 
-void GravitySimulator::setNextMassColor()
+void GravitySimulator::drawParticles(Renderer& renderer)
 {
-	if (m_nextMassColor == ORANGE) {
-		m_nextMassColor = YELLOW;
+	const float PARTICLE_RADIUS = 5;
+	const float REFERENCE_MASS = 100; // [Yg]
+
+	updateParticles(renderer, PARTICLE_RADIUS);
+
+	GPU_PROFILE_SCOPE("GPU Particles");
+	renderer.drawParticles(m_particles.data(), static_cast<int>(m_particles.size()), PARTICLE_RADIUS, REFERENCE_MASS);
+}
+
+void GravitySimulator::drawHeatmap(Renderer& renderer)
+{
+	const float SPLAT_RADIUS = 10;
+
+	updateParticles(renderer, SPLAT_RADIUS);
+
+	GPU_PROFILE_SCOPE("GPU Heatmap");
+	renderer.drawDensity(m_particles.data(), static_cast<int>(m_particles.size()), SPLAT_RADIUS, m_heatmapExposure);
+}
+
+void GravitySimulator::updateParticles(Renderer& renderer, float margin)
+{
+	Visibility visibility = updateVisibility(renderer, margin);
+
+	m_particles.clear();
+
+	for (int k = 0; k < visibility.massCount; k++) {
+		int i = visibility.masses[k];
+		const ImVec4& color = getMassColor(m_masses[i].colorIndex);
+
+		ParticleVertex particle;
+		particle.x = m_masses[i].position.x;
+		particle.y = m_masses[i].position.y;
+		particle.mass = m_masses[i].mass;
+		particle.r = color.x;
+		particle.g = color.y;
+		particle.b = color.z;
+		m_particles.push_back(particle);
 	}
-	else if (m_nextMassColor == YELLOW) {
-		m_nextMassColor = GREEN;
+
+	for (int k = 0; k < visibility.nodeCount; k++) {
+		const QuadTreeNode& node = m_spatialIndex.nodes()[visibility.nodes[k]];
+		const ImVec4& color = getMassColor(m_masses[m_spatialIndex.bodies()[node.firstBody]].colorIndex);
+
+		ParticleVertex particle;
+		particle.x = node.centerOfMass.x;
+		particle.y = node.centerOfMass.y;
+		particle.mass = node.mass;
+		particle.r = color.x;
+		particle.g = color.y;
+		particle.b = color.z;
+		m_particles.push_back(particle);
 	}
-	else if (m_nextMassColor == GREEN) {
-		m_nextMassColor = ORANGE;
+}
+
+GravitySimulator::Visibility GravitySimulator::updateVisibility(Renderer& renderer, float margin)
+{
+	PROFILE_SCOPE("Visibility");
+
+	m_spatialIndex.build(m_masses, m_threadPool);
+
+	const std::vector<QuadTreeNode>& nodes = m_spatialIndex.nodes();
+	const std::vector<int>& bodies = m_spatialIndex.bodies();
+
+	// Every body and node is visited at most once, which bounds all three
+	FrameArena& arena = getFrameArena();
+	int* visibleMasses = arena.allocateArray<int>(m_masses.size());
+	int* visibleNodes = arena.allocateArray<int>(nodes.size());
+	int* stack = arena.allocateArray<int>(nodes.size());
+
+	Visibility visibility = { visibleMasses, 0, visibleNodes, 0 };
+	if (m_masses.empty())
+		return visibility;
+
+	// The view rectangle in world space, grown so partially visible bodies survive
+	float left = -margin;
+	float bottom = -margin;
+	float right = renderer.width() + margin;
+	float top = renderer.height() + margin;
+	float pixelSize = renderer.scale();
+
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		int nodeIndex = stack[--stackSize];
+
+		const QuadTreeNode& node = nodes[nodeIndex];
+
+		if (node.bodyCount == 0
+			|| node.center.x + node.halfSize < left || node.center.x - node.halfSize > right
+			|| node.center.y + node.halfSize < bottom || node.center.y - node.halfSize > top) {
+			continue;
+		}
+
+		if (node.bodyCount > 1 && 2 * node.halfSize < pixelSize) {
+			visibleNodes[visibility.nodeCount++] = nodeIndex;
+		}
+		else if (node.firstChild == -1) {
+			for (int i = node.firstBody; i < node.firstBody + node.bodyCount; i++) {
+				const Vector2& position = m_masses[bodies[i]].position;
+				if (position.x >= left && position.x <= right && position.y >= bottom && position.y <= top) {
+					visibleMasses[visibility.massCount++] = bodies[i];
+				}
+			}
+		}
+		else {
+			for (int quadrant = 0; quadrant < 4; quadrant++) {
+				stack[stackSize++] = node.firstChild + quadrant;
+			}
+		}
+	}
+
+	return visibility;
+}
+
+void GravitySimulator::updateTrails(Renderer& renderer)
+{
+	if (!m_doDrawTrails || m_stepCount % m_trailInterval != 0)
+		return;
+
+	renderer.setTrailLength(m_trailLength, static_cast<std::size_t>(m_trailMemoryLimit) * 1024 * 1024);
+
+	m_trailPositions.resize(m_masses.size() * 2);
+
+	// Samples go in id order, so sorting the masses does not mix up trails
+	for (int id = 0; id < m_masses.size(); id++) {
+		const Mass& mass = m_masses[m_massIndices[id]];
+		m_trailPositions[2 * id] = mass.position.x;
+		m_trailPositions[2 * id + 1] = mass.position.y;
 	}
+
+	renderer.appendTrailSample(m_trailPositions.data(), static_cast<int>(m_masses.size()));
+}
+
+void GravitySimulator::setNextMassColor()
+{
+	m_nextColorIndex = (m_nextColorIndex + 1) % MASS_COLOR_COUNT;
 }
 
 void GravitySimulator::drawImGuiOverlay(Renderer& renderer)
@@ -167,86 +673,431 @@ void GravitySimulator::drawImGuiOverlay(Renderer& renderer)
 	ImGui::Text("Click to place a new mass.");
 	ImGui::Text("Click again to set its velocity.");
 
+	if (m_isReplaying) {
+		ImGui::Text("Replaying input log, step %u", m_stepCount);
+	}
+	else if (m_inputLog.isRecording()) {
+		ImGui::Text("Recording input log, step %u", m_stepCount);
+	}
+
 	ImGui::End();
 }
 
-void GravitySimulator::drawImGuiExistingMasses(Renderer&)
+void GravitySimulator::drawImGuiExistingMasses(Renderer& renderer)
 {
 	const ImVec4 BLACK = { 0.0f, 0.0f, 0.0f, 1.0f };
+	const bool USE_DARK_TEXT[MASS_COLOR_COUNT] = { false, true, true };
+	const char* COLOR_NAMES[] = { "All colors", "Orange", "Yellow", "Green" };
+
+	enum Column {
+		COLUMN_INDEX,
+		COLUMN_POSITION,
+		COLUMN_VELOCITY,
+		COLUMN_ACCELERATION,
+		COLUMN_MASS,
+	};
 
 	ImGui::Begin("Existing Masses");
 
 	if (ImGui::Button("Clear all masses")) {
-		m_masses.clear();
+		InputEvent event = {};
+		event.type = InputType::ClearMasses;
+		submitInput(renderer, event);
 	}
 
-	for (int i = 0; i < m_masses.size(); i++) {
-		if (m_masses[i].color.x == ORANGE[0].x && m_masses[i].color.y == ORANGE[0].y && m_masses[i].color.z == ORANGE[0].z) {
-			ImGui::PushStyleColor(ImGuiCol_Header, ORANGE[0]);
-			ImGui::PushStyleColor(ImGuiCol_HeaderHovered, ORANGE[1]);
-			ImGui::PushStyleColor(ImGuiCol_HeaderActive, ORANGE[2]);
+	m_massFilter.Draw("Filter", 120.0f);
+	ImGui::SameLine();
+	int colorFilter = m_massColorFilter + 1;
+	ImGui::SetNextItemWidth(100.0f);
+	if (ImGui::Combo("Color", &colorFilter, COLOR_NAMES, IM_ARRAYSIZE(COLOR_NAMES))) {
+		m_massColorFilter = colorFilter - 1;
+	}
+
+	// Collect the rows that pass the filters. The label is formatted into a
+	// stack buffer, so filtering never touches the heap.
+	m_massRows.clear();
+	for (int id = 0; id < m_masses.size(); id++) {
+		if (m_massColorFilter != -1 && m_masses[m_massIndices[id]].colorIndex != m_massColorFilter)
+			continue;
+
+		if (m_massFilter.IsActive()) {
+			char label[32];
+			std::snprintf(label, sizeof(label), "Mass %d", id + 1);
+			if (!m_massFilter.PassFilter(label))
+				continue;
 		}
-		else if (m_masses[i].color.x == YELLOW[0].x && m_masses[i].color.y == YELLOW[0].y && m_masses[i].color.z == YELLOW[0].z) {
-			ImGui::PushStyleColor(ImGuiCol_Header, YELLOW[0]);
-			ImGui::PushStyleColor(ImGuiCol_HeaderHovered, YELLOW[1]);
-			ImGui::PushStyleColor(ImGuiCol_HeaderActive, YELLOW[2]);
-			ImGui::PushStyleColor(ImGuiCol_Text, BLACK);
+
+		m_massRows.push_back(id);
+	}
+
+	ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable
+		| ImGuiTableFlags_Sortable | ImGuiTableFlags_ScrollY | ImGuiTableFlags_SizingStretchProp;
+
+	if (ImGui::BeginTable("Masses", 5, flags)) {
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("Mass", ImGuiTableColumnFlags_DefaultSort, 0.6f, COLUMN_INDEX);
+		ImGui::TableSetupColumn("Position [km]", 0, 1.0f, COLUMN_POSITION);
+		ImGui::TableSetupColumn("Velocity [km/s]", 0, 1.0f, COLUMN_VELOCITY);
+		ImGui::TableSetupColumn("Acceleration [km/s^2]", 0, 1.0f, COLUMN_ACCELERATION);
+		ImGui::TableSetupColumn("Mass [Yg]", 0, 0.6f, COLUMN_MASS);
+		ImGui::TableHeadersRow();
+
+		// Values change every step, so the order is refreshed every frame
+		ImGuiTableSortSpecs* sortSpecs = ImGui::TableGetSortSpecs();
+		if (sortSpecs != nullptr && sortSpecs->SpecsCount > 0) {
+			const ImGuiTableColumnSortSpecs& spec = sortSpecs->Specs[0];
+			bool isAscending = spec.SortDirection == ImGuiSortDirection_Ascending;
+
+			auto key = [&](int id) {
+				const Mass& mass = m_masses[m_massIndices[id]];
+
+				switch (spec.ColumnUserID) {
+				case COLUMN_POSITION:
+					return mass.position.x;
+				case COLUMN_VELOCITY:
+					return getLength(mass.velocity);
+				case COLUMN_ACCELERATION:
+					return getLength(mass.acceleration);
+				case COLUMN_MASS:
+					return mass.mass;
+				default:
+					return static_cast<float>(id);
+				}
+			};
+
+			// Rows are collected in ascending id order already
+			if (spec.ColumnUserID != COLUMN_INDEX || !isAscending) {
+				std::sort(m_massRows.begin(), m_massRows.end(), [&](int a, int b) {
+					float keyA = key(a);
+					float keyB = key(b);
+					if (keyA != keyB)
+						return isAscending ? keyA < keyB : keyA > keyB;
+					return a < b;
+				});
+			}
 		}
-		else if (m_masses[i].color.x == GREEN[0].x && m_masses[i].color.y == GREEN[0].y && m_masses[i].color.z == GREEN[0].z) {
-			ImGui::PushStyleColor(ImGuiCol_Header, GREEN[0]);
-			ImGui::PushStyleColor(ImGuiCol_HeaderHovered, GREEN[1]);
-			ImGui::PushStyleColor(ImGuiCol_HeaderActive, GREEN[2]);
-			ImGui::PushStyleColor(ImGuiCol_Text, BLACK);
+
+		// Only the rows inside the scroll region are submitted
+		ImGuiListClipper clipper;
+		clipper.Begin(static_cast<int>(m_massRows.size()));
+
+		while (clipper.Step()) {
+			for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+				const Mass& mass = m_masses[m_massIndices[m_massRows[row]]];
+
+				ImGui::TableNextRow();
+
+				ImGui::TableNextColumn();
+				ImGui::TableSetBgColor(ImGuiTableBgTarget_CellBg, ImGui::GetColorU32(getMassColor(mass.colorIndex)));
+				if (USE_DARK_TEXT[mass.colorIndex])
+					ImGui::PushStyleColor(ImGuiCol_Text, BLACK);
+				ImGui::Text("Mass %d", m_massRows[row] + 1);
+				if (USE_DARK_TEXT[mass.colorIndex])
+					ImGui::PopStyleColor();
+
+				ImGui::TableNextColumn();
+				ImGui::Text("(%.1f, %.1f)", mass.position.x, mass.position.y);
+				ImGui::TableNextColumn();
+				ImGui::Text("(%.1f, %.1f)", mass.velocity.x, mass.velocity.y);
+				ImGui::TableNextColumn();
+				ImGui::Text("(%.1f, %.1f)", mass.acceleration.x, mass.acceleration.y);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", mass.mass);
+			}
 		}
 
-		std::stringstream ss;
-		ss << "Mass ";
-		ss << i + 1;
+		ImGui::EndTable();
+	}
 
-		if (ImGui::CollapsingHeader(ss.str().c_str(), ImGuiTreeNodeFlags_DefaultOpen)) {
-			ImGui::PopStyleColor();
+	ImGui::End();
+}
 
-			ImGui::BeginTable("Mass Data", 2, ImGuiTableFlags_Borders);
+void GravitySimulator::drawImGuiNewMasses(Renderer& renderer)
+{
+	ImGui::Begin("New Masses");
+
+	// Edits are submitted as inputs so recorded sessions replay them
+	float newMassMass = m_newMassMass;
+	if (ImGui::InputFloat("Mass [Yg]", &newMassMass, 0.0f, 0.0f, "%.1f")) {
+		InputEvent event = {};
+		event.type = InputType::SetNewMassMass;
+		event.value = newMassMass;
+		submitInput(renderer, event);
+	}
+
+	bool doCircularOrbit = m_doCircularOrbit;
+	if (ImGui::Checkbox("Attempt circular orbit?", &doCircularOrbit)) {
+		InputEvent event = {};
+		event.type = InputType::SetCircularOrbit;
+		event.count = doCircularOrbit;
+		submitInput(renderer, event);
+	}
 
-			ImGui::TableNextColumn();
-			ImGui::Text("Position:");
-			ImGui::TableNextColumn();
-			ImGui::Text("(%.1f, %.1f) km", m_masses[i].position.x, m_masses[i].position.y);
+	ImGui::Separator();
 
-			ImGui::TableNextColumn();
-			ImGui::Text("Velocity:");
-			ImGui::TableNextColumn();
-			ImGui::Text("(%.1f, %.1f) km/s", m_masses[i].velocity.x, m_masses[i].velocity.y);
+	ImGui::SliderInt("Count", &m_scatterCount, 1, 100000, "%d", ImGuiSliderFlags_Logarithmic);
+	if (ImGui::Button("Scatter masses") && !m_isWaitingForVelocity) {
+		InputEvent event = {};
+		event.type = InputType::ScatterMasses;
+		event.position.x = renderer.width() / 2;
+		event.position.y = renderer.height() / 2;
+		event.count = m_scatterCount;
+		event.value = 0.4f * std::min(renderer.width(), renderer.height());
+		submitInput(renderer, event);
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Fills a disk at the center of the view with masses on circular orbits");
+	}
 
-			ImGui::TableNextColumn();
-			ImGui::Text("Acceleration:");
-			ImGui::TableNextColumn();
-			ImGui::Text("(%.1f, %.1f) km/s^2", m_masses[i].acceleration.x, m_masses[i].acceleration.y);
+	ImGui::End();
+}
 
-			ImGui::TableNextColumn();
-			ImGui::Text("Mass:");
-			ImGui::TableNextColumn();
-			ImGui::Text("%.1f Yg", m_masses[i].mass);
+void GravitySimulator::drawImGuiDisplay(Renderer& renderer)
+{
+	const char* renderModeNames[] = { "Circles", "Particles", "Heatmap" };
 
-			ImGui::EndTable();
-		}
-		else {
-			ImGui::PopStyleColor();
-		}
+	ImGui::Begin("Display");
+
+	int renderMode = static_cast<int>(m_renderMode);
+	if (ImGui::Combo("Render mode", &renderMode, renderModeNames, IM_ARRAYSIZE(renderModeNames))) {
+		m_renderMode = static_cast<RenderMode>(renderMode);
+	}
+
+	if (m_renderMode == RenderMode::Heatmap) {
+		ImGui::SliderFloat("Exposure", &m_heatmapExposure, 1.0f, 10000.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+	}
+
+	if (ImGui::Checkbox("Show orbit trails", &m_doDrawTrails) && !m_doDrawTrails) {
+		renderer.clearTrails();
+	}
+
+	if (m_doDrawTrails) {
+		ImGui::SliderInt("Trail length", &m_trailLength, 2, 1024);
+		ImGui::SliderInt("Steps per sample", &m_trailInterval, 1, 60);
+		ImGui::SliderInt("Trail memory [MiB]", &m_trailMemoryLimit, 16, 1024);
+		ImGui::Text("%d samples, %.1f MiB", renderer.trailSampleCount(), renderer.trailMemoryUsage() / (1024.0 * 1024.0));
 	}
 
 	ImGui::End();
 }
 
-void GravitySimulator::drawImGuiNewMasses(Renderer&)
+void GravitySimulator::drawImGuiForces(Renderer& renderer)
 {
-	if (m_masses.size() == 0)
-		m_doCircularOrbit = false;
+	ImGui::Begin("Forces");
 
-	ImGui::Begin("New Masses");
+	ForceEngine& selected = m_forceEngines.engine(m_forceEngines.selectedEngine());
+
+	if (ImGui::BeginCombo("Engine", m_forceEngineMode == -1 ? "Automatic" : selected.name())) {
+		if (ImGui::Selectable("Automatic", m_forceEngineMode == -1)) {
+			m_forceEngineMode = -1;
+			m_forceEngines.invalidate();
+		}
+
+		for (int i = 0; i < m_forceEngines.engineCount(); i++) {
+			ImGuiSelectableFlags flags = m_forceEngines.isAvailable(i) ? ImGuiSelectableFlags_None : ImGuiSelectableFlags_Disabled;
+			if (ImGui::Selectable(m_forceEngines.engine(i).name(), m_forceEngineMode == i, flags)) {
+				m_forceEngineMode = i;
+
+				InputEvent event = {};
+				event.type = InputType::SelectForceEngine;
+				event.count = i;
+				submitInput(renderer, event);
+			}
+		}
+
+		ImGui::EndCombo();
+	}
+
+	ImGui::SliderFloat("Error budget", &m_forceErrorBudget, 1e-6f, 1e-1f, "%.0e", ImGuiSliderFlags_Logarithmic);
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Largest RMS relative acceleration error, against direct summation, that automatic selection accepts");
+	}
+
+	// One parameter per criterion: theta for the geometric ones, alpha for
+	// the relative error
+	// Sliders submit once released, so a drag is one input and the engines
+	// and their caches are not rebuilt every frame of it
+	const OpeningTest& openingTest = m_forceEngines.openingTest();
+	OpeningCriterion criterion = openingTest.criterion();
+	bool isOpeningEdited = false;
+
+	if (ImGui::BeginCombo("Opening criterion", getOpeningCriterionName(criterion))) {
+		for (int c = 0; c < OPENING_CRITERION_COUNT; c++) {
+			if (ImGui::Selectable(getOpeningCriterionName(static_cast<OpeningCriterion>(c)), c == static_cast<int>(criterion))) {
+				criterion = static_cast<OpeningCriterion>(c);
+				m_openingParameter = openingTest.parameter(criterion);
+				isOpeningEdited = true;
+			}
+		}
+
+		ImGui::EndCombo();
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("When Barnes-Hut and TreePM use a cell's mass and quadrupole instead of opening it. Barnes-Hut compares the cell's width to its distance, Salmon-Warren the farthest reach of its bodies from their center of mass, and relative error an estimate of the error to each body's last acceleration.");
+	}
+
+	if (criterion == OpeningCriterion::RelativeError)
+		ImGui::SliderFloat("Error tolerance", &m_openingParameter, 1e-5f, 1e-1f, "%.0e", ImGuiSliderFlags_Logarithmic);
+	else
+		ImGui::SliderFloat("Opening angle", &m_openingParameter, 0.1f, 1.2f, "%.2f");
+	isOpeningEdited |= ImGui::IsItemDeactivatedAfterEdit();
+
+	if (isOpeningEdited) {
+		InputEvent event = {};
+		event.type = InputType::SetOpeningCriterion;
+		event.count = static_cast<int>(criterion);
+		event.value = m_openingParameter;
+		submitInput(renderer, event);
+	}
+	if (!ImGui::IsItemActive()) {
+		m_openingParameter = openingTest.parameter(openingTest.criterion());
+	}
+
+	ImGui::SliderInt("Multipole order", &m_fmmOrder, 2, 20);
+	if (ImGui::IsItemDeactivatedAfterEdit()) {
+		InputEvent event = {};
+		event.type = InputType::SetFmmOrder;
+		event.count = m_fmmOrder;
+		submitInput(renderer, event);
+	}
+	if (!ImGui::IsItemActive()) {
+		m_fmmOrder = m_forceEngines.fmm().order();
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Terms in the fast multipole expansions. Each extra term costs time and cuts the error.");
+	}
+
+	char meshLabel[16];
+	std::snprintf(meshLabel, sizeof(meshLabel), "%d", 16 << m_meshLevel);
+	ImGui::SliderInt("Mesh size", &m_meshLevel, 0, 8, meshLabel);
+	if (ImGui::IsItemDeactivatedAfterEdit()) {
+		InputEvent event = {};
+		event.type = InputType::SetMeshSize;
+		event.count = 16 << m_meshLevel;
+		submitInput(renderer, event);
+	}
+	if (!ImGui::IsItemActive()) {
+		m_meshLevel = getMeshLevel(m_forceEngines.pm().meshSize());
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Particle-mesh nodes per side, for both mesh engines. Particle-mesh forces are smoothed below a few mesh cells; TreePM sums those scales on its tree instead.");
+	}
+
+	bool isPeriodic = m_forceEngines.pm().boundary() == MeshBoundary::Periodic;
+	if (ImGui::Checkbox("Periodic mesh", &isPeriodic)) {
+		InputEvent event = {};
+		event.type = InputType::SetMeshBoundary;
+		event.count = isPeriodic;
+		submitInput(renderer, event);
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Treat the mesh as one tile of a periodic plane instead of zero-padding it to isolate the scene");
+	}
+
+	ImGui::Separator();
+
+	const PeriodicDomain& domain = m_forceEngines.domain();
+	bool isBoxPeriodic = domain.isEnabled;
+	bool isBoxEdited = ImGui::Checkbox("Periodic box", &isBoxPeriodic);
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Wrap masses around a square box starting at the origin, and sum forces over its periodic images");
+	}
+
+	ImGui::DragFloat("Box size [km]", &m_boxSize, 1.0f, 10.0f, 100000.0f, "%.0f");
+	isBoxEdited |= ImGui::IsItemDeactivatedAfterEdit() && isBoxPeriodic;
+
+	if (isBoxEdited) {
+		InputEvent event = {};
+		event.type = InputType::SetPeriodicDomain;
+		event.count = isBoxPeriodic;
+		event.position = { 0, 0 };
+		event.value = m_boxSize;
+		submitInput(renderer, event);
+	}
+
+	int sortInterval = m_sortInterval;
+	if (ImGui::SliderInt("Sort interval [steps]", &sortInterval, 0, 256)) {
+		InputEvent event = {};
+		event.type = InputType::SetSortInterval;
+		event.count = sortInterval;
+		submitInput(renderer, event);
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Steps between reordering the masses along a Morton curve, so bodies near in space are near in memory. 0 never sorts.");
+	}
+
+	int rebuildInterval = m_forceEngines.treeRebuildInterval();
+	if (ImGui::SliderInt("Tree rebuild interval [steps]", &rebuildInterval, 1, 64)) {
+		InputEvent event = {};
+		event.type = InputType::SetTreeRebuildInterval;
+		event.count = rebuildInterval;
+		submitInput(renderer, event);
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Steps between full tree builds. In between, cells keep their bodies and only their mass, center of mass and bounds are refit, and Barnes-Hut reuses its interaction lists, which suits slowly moving bodies.");
+	}
+
+	ImGui::Separator();
+
+	if (m_forceEngineMode == -1 && ImGui::Button("Benchmark now")) {
+		m_forceEngines.invalidate();
+	}
+
+	ImGui::Text("Using %s", selected.name());
+
+	if (m_forceEngines.benchmarkBodyCount() >= 0) {
+		ImGui::Text("Last benchmark: %d bodies", m_forceEngines.benchmarkBodyCount());
+
+		if (ImGui::BeginTable("Engines", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+			ImGui::TableSetupColumn("Engine");
+			ImGui::TableSetupColumn("Time [ms]");
+			ImGui::TableSetupColumn("Error");
+			ImGui::TableHeadersRow();
+
+			for (int i = 0; i < m_forceEngines.engineCount(); i++) {
+				const ForceEngineSelector::Measurement& measurement = m_forceEngines.measurement(i);
+
+				ImGui::TableNextRow();
+				if (i == m_forceEngines.selectedEngine())
+					ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg1, ImGui::GetColorU32(ImGuiCol_Header));
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%s", m_forceEngines.engine(i).name());
+
+				ImGui::TableNextColumn();
+				if (measurement.isMeasured)
+					ImGui::Text("%.3f", measurement.milliseconds);
+				else
+					ImGui::TextDisabled("skipped");
+
+				ImGui::TableNextColumn();
+				if (measurement.isMeasured)
+					ImGui::Text("%.1e", measurement.error);
+			}
+
+			// Barnes-Hut under each opening criterion, the current one marked
+			for (int c = 0; c < OPENING_CRITERION_COUNT; c++) {
+				OpeningCriterion rowCriterion = static_cast<OpeningCriterion>(c);
+				const ForceEngineSelector::Measurement& measurement = m_forceEngines.criterionMeasurement(rowCriterion);
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("  %s%s", getOpeningCriterionName(rowCriterion), rowCriterion == m_forceEngines.openingTest().criterion() ? " *" : "");
 
-	ImGui::InputFloat("Mass [Yg]", &m_newMassMass, 0.0f, 0.0f, "%.1f");
-	ImGui::Checkbox("Attempt circular orbit?", &m_doCircularOrbit);
+				ImGui::TableNextColumn();
+				if (measurement.isMeasured)
+					ImGui::Text("%.3f", measurement.milliseconds);
+				else
+					ImGui::TextDisabled("skipped");
+
+				ImGui::TableNextColumn();
+				if (measurement.isMeasured)
+					ImGui::Text("%.1e", measurement.error);
+			}
+
+			ImGui::EndTable();
+		}
+	}
 
 	ImGui::End();
 }
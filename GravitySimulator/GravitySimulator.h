@@ -1,14 +1,39 @@
 
 #pragma once
 
+#include <random>
+#include <string>
 #include <vector>
 
+#include "ForceEngineSelector.h"
+#include "InputLog.h"
 #include "Mass.h"
+#include "MortonSorter.h"
 #include "Program.h"
+#include "QuadTree.h"
+#include "ThreadPool.h"
+
+enum class RenderMode {
+	Circles,
+	Particles,
+	Heatmap,
+};
+
+struct SimulationOptions {
+	int threadCount = 0; // Zero uses every hardware thread
+
+	// Steps by a fixed time step instead of the display's refresh period, so
+	// a run depends only on its inputs. Recording or replaying turns it on.
+	bool isDeterministic = false;
+	unsigned seed = 1;
+
+	std::string recordPath; // Input log written while running
+	std::string replayPath; // Input log to play back; live inputs are ignored until it ends
+};
 
 class GravitySimulator : public Program {
 public:
-	explicit GravitySimulator();
+	explicit GravitySimulator(const SimulationOptions& = SimulationOptions());
 
 	void update(Renderer&) final;
 	void draw(Renderer&) final;
@@ -16,20 +41,82 @@ public:
 
 	void mousePressed(Renderer&, SDL_MouseButtonEvent) final;
 
+	float measureForceError(const std::string& engine) final;
+
 private:
-	std::vector<Mass> m_masses;
-	const ImVec4* m_nextMassColor;
+	// Bodies and cells in view, in the frame arena, so only valid this frame
+	struct Visibility {
+		const int* masses;
+		int massCount;
+		const int* nodes; // Sub-pixel cells drawn as a single splat
+		int nodeCount;
+	};
+
+	std::vector<Mass> m_masses; // Reordered along the Morton curve every m_sortInterval steps
+	std::vector<int> m_massIds; // Insertion order of the mass at each index, shown in the UI
+	std::vector<int> m_massIndices; // Current index of each id
+	MortonSorter m_sorter;
+	std::vector<Mass> m_sortedMasses;
+	std::vector<int> m_sortedIds;
+	int m_sortInterval; // [steps] Zero never sorts
+
+	ThreadPool m_threadPool;
+	ForceEngineSelector m_forceEngines;
+	int m_forceEngineMode; // -1 selects automatically, otherwise a fixed engine
+	float m_forceErrorBudget;
+	InputLog m_inputLog;
+	std::mt19937 m_random;
+	float m_timeStep; // [s] Zero follows the display refresh rate
+	bool m_isReplaying;
+	std::vector<ParticleVertex> m_particles;
+	std::vector<float> m_trailPositions;
+
+	QuadTree m_spatialIndex;
+
+	std::vector<int> m_massRows; // Ids in the filtered and sorted rows of the Existing Masses table
+	ImGuiTextFilter m_massFilter;
+	int m_massColorFilter; // -1 shows every color
+	int m_nextColorIndex;
 
 	bool m_isWaitingForVelocity;
 	bool m_doCircularOrbit;
 
 	float m_newMassMass;
 
-	Vector2 getAcceleration(float x, float y, int ignoreIndex);
+	RenderMode m_renderMode;
+	float m_heatmapExposure;
+
+	bool m_doDrawTrails;
+	int m_trailLength;
+	int m_trailInterval;
+	int m_trailMemoryLimit; // [MiB]
+	unsigned m_stepCount;
+	int m_scatterCount;
+	float m_boxSize; // [km] Side of the periodic box, kept while the plane is unbounded
+	float m_openingParameter; // Slider values, which the engines take once released
+	int m_fmmOrder;
+	int m_meshLevel; // Mesh size is 16 << m_meshLevel
+
+	void submitInput(Renderer&, InputEvent);
+	void applyInput(Renderer&, const InputEvent&);
+	void replayInputs(Renderer&);
+	void reserveMasses(std::size_t count);
+	void addMass(const Mass&);
+	void sortMasses();
+	void placeMass(Vector2 position, int clicks);
+	void scatterMasses(Vector2 center, int count, float radius);
+	void setDomain(Renderer&, bool isPeriodic, Vector2 origin, float size);
 	void drawMasses(Renderer&);
+	void drawParticles(Renderer&);
+	void drawHeatmap(Renderer&);
+	void updateParticles(Renderer&, float margin);
+	Visibility updateVisibility(Renderer&, float margin);
+	void updateTrails(Renderer&);
 	void setNextMassColor();
 
 	void drawImGuiOverlay(Renderer&);
 	void drawImGuiExistingMasses(Renderer&);
 	void drawImGuiNewMasses(Renderer&);
+	void drawImGuiDisplay(Renderer&);
+	void drawImGuiForces(Renderer&);
 };
@@ -0,0 +1,196 @@
+#include <cstring>
+
+#include <SDL.h>
+
+#include "InputLog.h"
+
+// Global Constants
+namespace {
+
+	const char* const HEADER = "gravity-input-log 1";
+
+	const char* const TYPE_NAMES[] = { "place", "clear", "new-mass", "circular-orbit", "scatter", "checksum", "force-engine", "fmm-order", "mesh-size", "mesh-boundary", "periodic-domain", "tree-rebuild-interval", "sort-interval", "opening-criterion" };
+	const int TYPE_COUNT = sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]);
+
+};
+
+InputLog::InputLog() : m_file(nullptr), m_nextEvent(0), m_timeStep(0), m_seed(0)
+{
+}
+
+InputLog::~InputLog()
+{
+	if (m_file != nullptr)
+		std::fclose(m_file);
+}
+
+bool InputLog::startRecording(const std::string& path, float timeStep, unsigned seed)
+{
+	m_file = std::fopen(path.c_str(), "w");
+	if (m_file == nullptr) {
+		SDL_Log("Failed to open input log %s for writing", path.c_str());
+		return false;
+	}
+
+	m_timeStep = timeStep;
+	m_seed = seed;
+
+	std::fprintf(m_file, "%s\ntime-step %a\nseed %u\n", HEADER, timeStep, seed);
+	std::fflush(m_file);
+
+	return true;
+}
+
+void InputLog::record(const InputEvent& event)
+{
+	if (m_file == nullptr)
+		return;
+
+	std::fprintf(m_file, "%u %s", event.step, TYPE_NAMES[static_cast<int>(event.type)]);
+
+	switch (event.type) {
+	case InputType::PlaceMass:
+		std::fprintf(m_file, " %a %a %d", event.position.x, event.position.y, event.count);
+		break;
+	case InputType::SetNewMassMass:
+		std::fprintf(m_file, " %a", event.value);
+		break;
+	case InputType::SetCircularOrbit:
+	case InputType::SelectForceEngine:
+	case InputType::SetFmmOrder:
+	case InputType::SetMeshSize:
+	case InputType::SetMeshBoundary:
+	case InputType::SetTreeRebuildInterval:
+	case InputType::SetSortInterval:
+		std::fprintf(m_file, " %d", event.count);
+		break;
+	case InputType::ScatterMasses:
+		std::fprintf(m_file, " %a %a %d %a", event.position.x, event.position.y, event.count, event.value);
+		break;
+	case InputType::SetPeriodicDomain:
+		std::fprintf(m_file, " %d %a %a %a", event.count, event.position.x, event.position.y, event.value);
+		break;
+	case InputType::SetOpeningCriterion:
+		std::fprintf(m_file, " %d %a", event.count, event.value);
+		break;
+	case InputType::Checksum:
+		std::fprintf(m_file, " %016llx", static_cast<unsigned long long>(event.checksum));
+		break;
+	case InputType::ClearMasses:
+		break;
+	}
+
+	std::fprintf(m_file, "\n");
+	std::fflush(m_file);
+}
+
+bool InputLog::isRecording() const
+{
+	return m_file != nullptr;
+}
+
+bool InputLog::load(const std::string& path)
+{
+	std::FILE* file = std::fopen(path.c_str(), "r");
+	if (file == nullptr) {
+		SDL_Log("Failed to open input log %s", path.c_str());
+		return false;
+	}
+
+	char line[256];
+	bool isValid = std::fgets(line, sizeof(line), file) != nullptr && std::strncmp(line, HEADER, std::strlen(HEADER)) == 0
+		&& std::fscanf(file, " time-step %f seed %u", &m_timeStep, &m_seed) == 2;
+
+	m_events.clear();
+	m_nextEvent = 0;
+
+	while (isValid) {
+		InputEvent event = {};
+		char typeName[32];
+
+		int fieldCount = std::fscanf(file, "%u %31s", &event.step, typeName);
+		if (fieldCount == EOF)
+			break;
+
+		int type = 0;
+		while (type < TYPE_COUNT && std::strcmp(typeName, TYPE_NAMES[type]) != 0) {
+			type++;
+		}
+
+		if (fieldCount != 2 || type == TYPE_COUNT) {
+			isValid = false;
+			break;
+		}
+
+		event.type = static_cast<InputType>(type);
+
+		unsigned long long checksum = 0;
+
+		switch (event.type) {
+		case InputType::PlaceMass:
+			isValid = std::fscanf(file, "%f %f %d", &event.position.x, &event.position.y, &event.count) == 3;
+			break;
+		case InputType::SetNewMassMass:
+			isValid = std::fscanf(file, "%f", &event.value) == 1;
+			break;
+		case InputType::SetCircularOrbit:
+		case InputType::SelectForceEngine:
+		case InputType::SetFmmOrder:
+		case InputType::SetMeshSize:
+		case InputType::SetMeshBoundary:
+		case InputType::SetTreeRebuildInterval:
+		case InputType::SetSortInterval:
+			isValid = std::fscanf(file, "%d", &event.count) == 1;
+			break;
+		case InputType::ScatterMasses:
+			isValid = std::fscanf(file, "%f %f %d %f", &event.position.x, &event.position.y, &event.count, &event.value) == 4;
+			break;
+		case InputType::SetPeriodicDomain:
+			isValid = std::fscanf(file, "%d %f %f %f", &event.count, &event.position.x, &event.position.y, &event.value) == 4;
+			break;
+		case InputType::SetOpeningCriterion:
+			isValid = std::fscanf(file, "%d %f", &event.count, &event.value) == 2;
+			break;
+		case InputType::Checksum:
+			isValid = std::fscanf(file, "%llx", &checksum) == 1;
+			event.checksum = checksum;
+			break;
+		case InputType::ClearMasses:
+			break;
+		}
+
+		m_events.push_back(event);
+	}
+
+	std::fclose(file);
+
+	if (!isValid) {
+		SDL_Log("Input log %s is malformed after %d events", path.c_str(), static_cast<int>(m_events.size()));
+		m_events.clear();
+	}
+
+	return isValid;
+}
+
+bool InputLog::isReplaying() const
+{
+	return m_nextEvent < m_events.size();
+}
+
+const InputEvent* InputLog::nextEvent(unsigned step)
+{
+	if (m_nextEvent == m_events.size() || m_events[m_nextEvent].step > step)
+		return nullptr;
+
+	return &m_events[m_nextEvent++];
+}
+
+float InputLog::timeStep() const
+{
+	return m_timeStep;
+}
+
+unsigned InputLog::seed() const
+{
+	return m_seed;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Vector2.h"
+
+// Inputs that change the simulation, as opposed to the view
+enum class InputType {
+	PlaceMass, // Places a mass, or sets the velocity of the one waiting for it
+	ClearMasses,
+	SetNewMassMass,
+	SetCircularOrbit,
+	ScatterMasses, // count masses in a disk of radius value around position
+	Checksum, // State hash after step, used to check a replay for drift
+	SelectForceEngine, // Engine index in count. Automatic choices are logged too, since they depend on timing.
+	SetFmmOrder, // Expansion order in count
+	SetMeshSize, // Particle-mesh and TreePM nodes per side in count
+	SetMeshBoundary, // MeshBoundary in count
+	SetPeriodicDomain, // Enabled in count, lower corner in position, side length in value
+	SetTreeRebuildInterval, // Steps between full tree builds in count
+	SetSortInterval, // Steps between Morton sorts in count, zero for never. Sorting changes summation order.
+	SetOpeningCriterion, // OpeningCriterion in count, its parameter in value
+};
+
+struct InputEvent {
+	unsigned step; // Simulation steps completed when the input was applied
+	InputType type;
+	Vector2 position; // World space
+	int count; // Clicks, masses, an engine or a boolean, depending on the type
+	float value;
+	std::uint64_t checksum;
+};
+
+// Text log of simulation inputs keyed by step. Floats are stored in hex so a
+// replay reproduces them bit for bit. A log being recorded is flushed after
+// every event, so a crashed session can still be replayed.
+class InputLog {
+public:
+	explicit InputLog();
+	~InputLog();
+
+	InputLog(const InputLog&) = delete;
+	InputLog& operator=(const InputLog&) = delete;
+
+	bool startRecording(const std::string& path, float timeStep, unsigned seed);
+	void record(const InputEvent&);
+	bool isRecording() const;
+
+	// Reads a whole log for replay. Returns false if it could not be parsed.
+	bool load(const std::string& path);
+	bool isReplaying() const;
+
+	// The next unreplayed event if it belongs to step, otherwise nullptr
+	const InputEvent* nextEvent(unsigned step);
+
+	float timeStep() const;
+	unsigned seed() const;
+
+private:
+	std::FILE* m_file;
+	std::vector<InputEvent> m_events;
+	std::size_t m_nextEvent;
+	float m_timeStep;
+	unsigned m_seed;
+};
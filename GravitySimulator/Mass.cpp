@@ -1,25 +1,58 @@
 
 #include "Mass.h"
 
-void applyAcceleration(Mass& mass, float secondsPerFrame)
+// Global Constants
+namespace {
+
+	const ImVec4 MASS_COLORS[MASS_COLOR_COUNT][3] = {
+		{ // Orange
+			{1.0f, 0.4f, 0.0f, 1.0f},
+			{1.0f, 0.6f, 0.0f, 1.0f},
+			{1.0f, 0.8f, 0.0f, 1.0f},
+		},
+		{ // Yellow
+			{1.0f, 1.0f, 0.0f, 1.0f},
+			{1.0f, 1.0f, 0.6f, 1.0f},
+			{1.0f, 1.0f, 0.8f, 1.0f},
+		},
+		{ // Green
+			{0.0f, 0.8f, 0.0f, 1.0f},
+			{0.0f, 1.0f, 0.2f, 1.0f},
+			{0.4f, 1.0f, 0.4f, 1.0f},
+		},
+	};
+
+};
+
+void applyAcceleration(Mass& mass, float secondsPerFrame, const PeriodicDomain& domain)
 {
 	if (!mass.doIgnore) {
 		mass.velocity += mass.acceleration * secondsPerFrame; // [km/s] += [km/s^2]*[s]
 		mass.position += mass.velocity * secondsPerFrame; // [km] += [km/s]*[s]
+		mass.position = wrapPosition(domain, mass.position);
 	}
 }
 
-void drawMass(Renderer& renderer, const Mass& mass)
+void drawMassVectors(Renderer& renderer, const Mass& mass)
 {
-	const float MASS_RADIUS = 5;
-
 	if (!mass.doIgnore) {
 		renderer.setColor(1.0f, 0.0f, 0.0f);
 		drawVector(renderer, mass.position.x, mass.position.y, mass.acceleration);
 		renderer.setColor(0.0f, 0.0f, 1.0f);
 		drawVector(renderer, mass.position.x, mass.position.y, mass.velocity);
 	}
+}
 
-	renderer.setColor(mass.color.x, mass.color.y, mass.color.z);
+void drawMass(Renderer& renderer, const Mass& mass)
+{
+	const float MASS_RADIUS = 5;
+
+	const ImVec4& color = getMassColor(mass.colorIndex);
+	renderer.setColor(color.x, color.y, color.z);
 	renderer.drawCircle(mass.position.x, mass.position.y, MASS_RADIUS);
 }
+
+const ImVec4& getMassColor(int colorIndex, int shade)
+{
+	return MASS_COLORS[colorIndex][shade];
+}
@@ -5,11 +5,14 @@
 
 #include "imgui/imgui.h"
 
+#include "PeriodicDomain.h"
 #include "Renderer.h"
 #include "Vector2.h"
 
+const int MASS_COLOR_COUNT = 3;
+
 struct Mass {
-	ImVec4 color;
+	int colorIndex; // Into the mass color palette
 	Vector2 position;
 	Vector2 velocity;
 	Vector2 acceleration;
@@ -17,5 +20,9 @@ struct Mass {
 	bool doIgnore;
 };
 
-void applyAcceleration(Mass&, float secondsPerFrame);
-void drawMass(Renderer&, const Mass&);
\ No newline at end of file
+void applyAcceleration(Mass&, float secondsPerFrame, const PeriodicDomain& = PeriodicDomain()); // Wraps the position into a periodic domain
+void drawMass(Renderer&, const Mass&);
+void drawMassVectors(Renderer&, const Mass&); // Acceleration and velocity arrows
+
+// Shade 0 is the base color, 1 and 2 are the hovered and active highlights
+const ImVec4& getMassColor(int colorIndex, int shade = 0);
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include <algorithm>
+
+#include "MortonSorter.h"
+
+// Global Constants
+namespace {
+
+	const int GRAIN_SIZE = 4096; // Bodies per parallel task
+	const int MAX_CHUNKS = 64; // Fixed partition for the radix passes
+	const int DIGIT_BITS = 8;
+	const int DIGIT_COUNT = 1 << DIGIT_BITS;
+	const int KEY_BITS = 32;
+
+};
+
+// Local functions
+namespace {
+
+// Spreads the low 16 bits of value to the even bits of the result
+std::uint32_t spreadBits(std::uint32_t value)
+{
+	value &= 0x0000FFFF;
+	value = (value | (value << 8)) & 0x00FF00FF;
+	value = (value | (value << 4)) & 0x0F0F0F0F;
+	value = (value | (value << 2)) & 0x33333333;
+	value = (value | (value << 1)) & 0x55555555;
+	return value;
+}
+
+};
+
+const std::vector<int>& MortonSorter::sort(const std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	int count = static_cast<int>(masses.size());
+
+	m_order.resize(count);
+	m_sortedOrder.resize(count);
+	m_sortedKeys.resize(count);
+
+	if (count == 0) {
+		m_keys.clear();
+		return m_order;
+	}
+
+	computeKeys(masses, threadPool);
+
+	for (int i = 0; i < count; i++) {
+		m_order[i] = i;
+	}
+
+	int chunkCount = std::min(MAX_CHUNKS, (count + GRAIN_SIZE - 1) / GRAIN_SIZE);
+	int chunkSize = (count + chunkCount - 1) / chunkCount;
+	m_counts.resize(chunkCount * DIGIT_COUNT);
+
+	for (int shift = 0; shift < KEY_BITS; shift += DIGIT_BITS) {
+		std::fill(m_counts.begin(), m_counts.end(), 0);
+
+		threadPool.parallelFor(chunkCount, 1, [&](int begin, int end) {
+			for (int chunk = begin; chunk < end; chunk++) {
+				int* counts = m_counts.data() + chunk * DIGIT_COUNT;
+				int last = std::min(count, (chunk + 1) * chunkSize);
+
+				for (int i = chunk * chunkSize; i < last; i++) {
+					counts[(m_keys[i] >> shift) & (DIGIT_COUNT - 1)]++;
+				}
+			}
+		});
+
+		// Offsets run digit by digit and, within a digit, chunk by chunk, so
+		// equal digits keep their order
+		int offset = 0;
+		for (int digit = 0; digit < DIGIT_COUNT; digit++) {
+			for (int chunk = 0; chunk < chunkCount; chunk++) {
+				int& slot = m_counts[chunk * DIGIT_COUNT + digit];
+				int digitCount = slot;
+				slot = offset;
+				offset += digitCount;
+			}
+		}
+
+		threadPool.parallelFor(chunkCount, 1, [&](int begin, int end) {
+			for (int chunk = begin; chunk < end; chunk++) {
+				int* offsets = m_counts.data() + chunk * DIGIT_COUNT;
+				int last = std::min(count, (chunk + 1) * chunkSize);
+
+				for (int i = chunk * chunkSize; i < last; i++) {
+					int destination = offsets[(m_keys[i] >> shift) & (DIGIT_COUNT - 1)]++;
+					m_sortedKeys[destination] = m_keys[i];
+					m_sortedOrder[destination] = m_order[i];
+				}
+			}
+		});
+
+		m_keys.swap(m_sortedKeys);
+		m_order.swap(m_sortedOrder);
+	}
+
+	return m_order;
+}
+
+const std::vector<std::uint32_t>& MortonSorter::keys() const
+{
+	return m_keys;
+}
+
+Vector2 MortonSorter::origin() const
+{
+	return m_origin;
+}
+
+float MortonSorter::size() const
+{
+	return m_size;
+}
+
+void MortonSorter::computeKeys(const std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	int count = static_cast<int>(masses.size());
+
+	Vector2 minimum = masses[0].position;
+	Vector2 maximum = masses[0].position;
+
+	for (const Mass& mass : masses) {
+		minimum.x = std::min(minimum.x, mass.position.x);
+		minimum.y = std::min(minimum.y, mass.position.y);
+		maximum.x = std::max(maximum.x, mass.position.x);
+		maximum.y = std::max(maximum.y, mass.position.y);
+	}
+
+	// One scale for both axes, so cells of the curve stay square. The
+	// square is padded so no body sits on its far edge.
+	float extent = std::max(maximum.x - minimum.x, maximum.y - minimum.y) * 1.0001f + 0.001f;
+	float scale = 65536.0f / extent;
+
+	m_origin = minimum;
+	m_size = extent;
+
+	m_keys.resize(count);
+
+	threadPool.parallelFor(count, GRAIN_SIZE, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			std::uint32_t x = static_cast<std::uint32_t>(std::min((masses[i].position.x - minimum.x) * scale, 65535.0f));
+			std::uint32_t y = static_cast<std::uint32_t>(std::min((masses[i].position.y - minimum.y) * scale, 65535.0f));
+			m_keys[i] = spreadBits(x) | (spreadBits(y) << 1);
+		}
+	});
+}
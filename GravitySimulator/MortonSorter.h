@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Mass.h"
+#include "ThreadPool.h"
+
+// Orders masses along the Z-order (Morton) curve of their bounding square.
+// Interleaving the bits of the quantized coordinates keeps bodies that are
+// near each other in space near each other in memory, which is what tree
+// builds and walks want. The sort is a stable least-significant-digit radix
+// sort, so the order does not depend on the thread count.
+class MortonSorter {
+public:
+	static const int KEY_LEVELS = 16; // Bits per axis, so quadtree levels a key can tell apart
+
+	// Returns mass indices in Morton order. Valid until the next call.
+	const std::vector<int>& sort(const std::vector<Mass>&, ThreadPool&);
+
+	// Keys of the sorted masses. Each pair of bits, from the top, picks a
+	// quadrant: bit 0 of the pair is the x half and bit 1 the y half.
+	const std::vector<std::uint32_t>& keys() const;
+
+	// The square the keys quantize, as of the last sort
+	Vector2 origin() const;
+	float size() const;
+
+private:
+	Vector2 m_origin;
+	float m_size;
+
+	std::vector<std::uint32_t> m_keys;
+	std::vector<std::uint32_t> m_sortedKeys;
+	std::vector<int> m_order;
+	std::vector<int> m_sortedOrder;
+	std::vector<int> m_counts; // Digit counts, then offsets, per chunk
+
+	void computeKeys(const std::vector<Mass>&, ThreadPool&);
+};
@@ -0,0 +1,69 @@
+#include <cmath>
+
+#include "ForceEngine.h"
+#include "OpeningCriterion.h"
+
+// Global Constants
+namespace {
+
+	const float DEFAULT_SALMON_WARREN_ANGLE = 0.5f; // Reach is about 0.7 cell widths when bodies fill the cell
+	const float DEFAULT_ERROR_TOLERANCE = 0.001f;
+
+	const char* CRITERION_NAMES[] = { "Barnes-Hut", "Salmon-Warren", "Relative error" };
+
+};
+
+const char* getOpeningCriterionName(OpeningCriterion criterion)
+{
+	return CRITERION_NAMES[static_cast<int>(criterion)];
+}
+
+OpeningTest::OpeningTest(float openingAngle) : m_criterion(OpeningCriterion::BarnesHut)
+{
+	m_parameters[static_cast<int>(OpeningCriterion::BarnesHut)] = openingAngle;
+	m_parameters[static_cast<int>(OpeningCriterion::SalmonWarren)] = DEFAULT_SALMON_WARREN_ANGLE;
+	m_parameters[static_cast<int>(OpeningCriterion::RelativeError)] = DEFAULT_ERROR_TOLERANCE;
+}
+
+OpeningCriterion OpeningTest::criterion() const
+{
+	return m_criterion;
+}
+
+void OpeningTest::setCriterion(OpeningCriterion criterion)
+{
+	m_criterion = criterion;
+}
+
+float OpeningTest::parameter(OpeningCriterion criterion) const
+{
+	return m_parameters[static_cast<int>(criterion)];
+}
+
+void OpeningTest::setParameter(OpeningCriterion criterion, float parameter)
+{
+	m_parameters[static_cast<int>(criterion)] = parameter;
+}
+
+bool OpeningTest::accepts(const QuadTreeNode& node, float distanceSquared, float acceleration) const
+{
+	float width = 2 * node.halfSize;
+
+	switch (m_criterion) {
+	case OpeningCriterion::SalmonWarren: {
+		float theta = parameter(OpeningCriterion::SalmonWarren);
+		return node.reach * node.reach < theta * theta * distanceSquared;
+	}
+	case OpeningCriterion::RelativeError:
+		// With quadrupoles the first term left out is the octupole, of size
+		// G M w^3 / d^4 in two dimensions
+		if (acceleration > 0)
+			return GRAVITATIONAL_CONSTANT * node.mass * width * width * width < parameter(OpeningCriterion::RelativeError) * acceleration * distanceSquared * distanceSquared;
+		break;
+	case OpeningCriterion::BarnesHut:
+		break;
+	}
+
+	float theta = parameter(OpeningCriterion::BarnesHut);
+	return width * width < theta * theta * distanceSquared;
+}
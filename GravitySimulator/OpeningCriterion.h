@@ -0,0 +1,38 @@
+#pragma once
+
+#include "QuadTree.h"
+
+// When a tree walk may use a cell's multipoles instead of opening it
+enum class OpeningCriterion {
+	BarnesHut, // Cell width under theta times the distance
+	SalmonWarren, // Farthest body from the cell's center of mass under theta times the distance
+	RelativeError, // Estimated truncation error under alpha times the target's acceleration
+};
+
+const int OPENING_CRITERION_COUNT = 3;
+
+const char* getOpeningCriterionName(OpeningCriterion);
+
+// A criterion and a parameter for each one, theta for the geometric ones and
+// alpha for the relative error, so switching back keeps earlier settings.
+// The relative error needs an acceleration to compare against; until a
+// target has one it falls back to Barnes-Hut.
+class OpeningTest {
+public:
+	explicit OpeningTest(float openingAngle = 0.7f); // For Barnes-Hut
+
+	OpeningCriterion criterion() const;
+	void setCriterion(OpeningCriterion);
+
+	float parameter(OpeningCriterion) const;
+	void setParameter(OpeningCriterion, float);
+
+	// distanceSquared is from the target, or the nearest point of a group of
+	// targets, to the cell's center of mass. acceleration is the smallest
+	// magnitude expected among the targets, 0 if not known yet.
+	bool accepts(const QuadTreeNode&, float distanceSquared, float acceleration) const;
+
+private:
+	OpeningCriterion m_criterion;
+	float m_parameters[OPENING_CRITERION_COUNT];
+};
@@ -0,0 +1,143 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "PerfCounters.h"
+
+// Local state and functions
+namespace {
+
+	std::atomic<bool> hardwareCountersEnabled(false);
+	std::atomic<int> openError(0); // errno of the first failed perf_event_open
+
+#ifdef __linux__
+
+	struct ThreadCounters {
+		bool isOpened = false;
+		bool isAvailable = false;
+		int groupLeader = -1;
+		int descriptors[HARDWARE_COUNTER_COUNT];
+
+		~ThreadCounters()
+		{
+			if (isAvailable) {
+				for (int descriptor : descriptors) {
+					close(descriptor);
+				}
+			}
+		}
+	};
+
+	thread_local ThreadCounters threadCounters;
+
+	int openCounter(std::uint64_t config, int groupLeader)
+	{
+		perf_event_attr attributes;
+		std::memset(&attributes, 0, sizeof(attributes));
+		attributes.size = sizeof(attributes);
+		attributes.type = PERF_TYPE_HARDWARE;
+		attributes.config = config;
+		attributes.disabled = groupLeader == -1 ? 1 : 0;
+		attributes.exclude_kernel = 1; // Allowed at the default perf_event_paranoid level
+		attributes.exclude_hv = 1;
+		attributes.read_format = PERF_FORMAT_GROUP;
+
+		return static_cast<int>(syscall(__NR_perf_event_open, &attributes, 0, -1, groupLeader, 0));
+	}
+
+	void openThreadCounters(ThreadCounters& counters)
+	{
+		const std::uint64_t CONFIGS[HARDWARE_COUNTER_COUNT] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES,
+		};
+
+		counters.isOpened = true;
+
+		for (int i = 0; i < HARDWARE_COUNTER_COUNT; i++) {
+			counters.descriptors[i] = openCounter(CONFIGS[i], counters.groupLeader);
+
+			if (counters.descriptors[i] == -1) {
+				int expected = 0;
+				openError.compare_exchange_strong(expected, errno);
+
+				for (int j = 0; j < i; j++) {
+					close(counters.descriptors[j]);
+				}
+				return;
+			}
+
+			if (i == 0)
+				counters.groupLeader = counters.descriptors[0];
+		}
+
+		// The whole group counts together, so ratios such as IPC are consistent
+		ioctl(counters.groupLeader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(counters.groupLeader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		counters.isAvailable = true;
+	}
+
+#endif
+
+};
+
+void setHardwareCountersEnabled(bool isEnabled)
+{
+	hardwareCountersEnabled.store(isEnabled, std::memory_order_relaxed);
+}
+
+bool areHardwareCountersEnabled()
+{
+	return hardwareCountersEnabled.load(std::memory_order_relaxed);
+}
+
+bool readHardwareCounters(HardwareCounts& counts)
+{
+	if (!areHardwareCountersEnabled())
+		return false;
+
+#ifdef __linux__
+	ThreadCounters& counters = threadCounters;
+
+	if (!counters.isOpened)
+		openThreadCounters(counters);
+	if (!counters.isAvailable)
+		return false;
+
+	struct {
+		std::uint64_t count;
+		std::uint64_t values[HARDWARE_COUNTER_COUNT];
+	} group;
+
+	if (read(counters.groupLeader, &group, sizeof(group)) != sizeof(group))
+		return false;
+
+	for (int i = 0; i < HARDWARE_COUNTER_COUNT; i++) {
+		counts.values[i] = group.values[i];
+	}
+
+	return true;
+#else
+	(void)counts;
+	return false;
+#endif
+}
+
+const char* getHardwareCountersError()
+{
+#ifdef __linux__
+	int error = openError.load(std::memory_order_relaxed);
+	return error != 0 ? std::strerror(error) : nullptr;
+#else
+	return "Hardware counters require Linux perf_event.";
+#endif
+}
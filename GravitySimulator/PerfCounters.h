@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// Hardware performance counters for the profiler, backed by perf_event on
+// Linux. Counters are opened lazily on each thread that reads them. Where
+// perf_event is unavailable or restricted (other platforms, containers, a
+// high perf_event_paranoid), reads fail and the profiler shows timings only.
+
+enum HardwareCounter {
+	HARDWARE_CYCLES,
+	HARDWARE_INSTRUCTIONS,
+	HARDWARE_CACHE_MISSES,
+	HARDWARE_BRANCH_MISSES,
+	HARDWARE_COUNTER_COUNT,
+};
+
+struct HardwareCounts {
+	std::uint64_t values[HARDWARE_COUNTER_COUNT];
+};
+
+void setHardwareCountersEnabled(bool);
+bool areHardwareCountersEnabled();
+
+// Returns false when counting is disabled or unavailable on this thread
+bool readHardwareCounters(HardwareCounts&);
+
+// Explains why counters are unavailable, or returns nullptr if they work
+const char* getHardwareCountersError();
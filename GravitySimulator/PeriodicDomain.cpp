@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "PeriodicDomain.h"
+
+// Global Constants
+namespace {
+
+	const int TABLE_SIZE = 64; // Intervals per axis over half a box
+	const int IMAGE_RANGE = 3; // Real-space images summed per axis
+	const int WAVE_RANGE = 6; // Reciprocal-space terms summed per axis
+	const double SPLIT_WIDTH = 0.25; // Ewald split, in box lengths
+
+};
+
+// Local functions
+namespace {
+
+// Correction for a unit box and unit strength: everything but the nearest
+// image's r / |r|^2. The Gaussian split puts r_n / |r_n|^2 exp(-|r_n|^2 / 4 s^2)
+// in real space and the rest in Fourier space, both of which converge fast.
+void computeCorrection(double x, double y, double& correctionX, double& correctionY)
+{
+	double splitScale = -1 / (4 * SPLIT_WIDTH * SPLIT_WIDTH);
+	double sumX = 0;
+	double sumY = 0;
+
+	for (int i = -IMAGE_RANGE; i <= IMAGE_RANGE; i++) {
+		for (int j = -IMAGE_RANGE; j <= IMAGE_RANGE; j++) {
+			double rx = x + i;
+			double ry = y + j;
+			double rSquared = rx * rx + ry * ry;
+
+			if (i == 0 && j == 0) {
+				// The nearest image's short-range part minus its whole pull
+				if (rSquared > 0) {
+					double factor = std::expm1(rSquared * splitScale) / rSquared;
+					sumX += rx * factor;
+					sumY += ry * factor;
+				}
+			}
+			else {
+				double factor = std::exp(rSquared * splitScale) / rSquared;
+				sumX += rx * factor;
+				sumY += ry * factor;
+			}
+		}
+	}
+
+	for (int i = -WAVE_RANGE; i <= WAVE_RANGE; i++) {
+		for (int j = -WAVE_RANGE; j <= WAVE_RANGE; j++) {
+			if (i == 0 && j == 0)
+				continue;
+
+			double kx = 2 * M_PI * i;
+			double ky = 2 * M_PI * j;
+			double kSquared = kx * kx + ky * ky;
+			double factor = 2 * M_PI * std::exp(-kSquared * SPLIT_WIDTH * SPLIT_WIDTH) / kSquared * std::sin(kx * x + ky * y);
+			sumX += kx * factor;
+			sumY += ky * factor;
+		}
+	}
+
+	correctionX = sumX;
+	correctionY = sumY;
+}
+
+struct EwaldTable {
+	std::vector<Vector2> values; // (TABLE_SIZE + 1)^2 over [0, 1/2]^2, row by y
+
+	explicit EwaldTable() : values((TABLE_SIZE + 1) * (TABLE_SIZE + 1))
+	{
+		for (int row = 0; row <= TABLE_SIZE; row++) {
+			for (int column = 0; column <= TABLE_SIZE; column++) {
+				double correctionX;
+				double correctionY;
+				computeCorrection(0.5 * column / TABLE_SIZE, 0.5 * row / TABLE_SIZE, correctionX, correctionY);
+
+				values[row * (TABLE_SIZE + 1) + column] = { static_cast<float>(correctionX), static_cast<float>(correctionY) };
+			}
+		}
+	}
+};
+
+const EwaldTable& getEwaldTable()
+{
+	static const EwaldTable table;
+	return table;
+}
+
+};
+
+Vector2 wrapPosition(const PeriodicDomain& domain, Vector2 position)
+{
+	if (!domain.isEnabled)
+		return position;
+
+	Vector2 offset = position - domain.origin;
+	offset.x -= domain.size * std::floor(offset.x / domain.size);
+	offset.y -= domain.size * std::floor(offset.y / domain.size);
+
+	// Rounding can land exactly on the far edge
+	if (offset.x >= domain.size)
+		offset.x = 0;
+	if (offset.y >= domain.size)
+		offset.y = 0;
+
+	return domain.origin + offset;
+}
+
+Vector2 getNearestImage(const PeriodicDomain& domain, Vector2 displacement)
+{
+	if (!domain.isEnabled)
+		return displacement;
+
+	displacement.x -= domain.size * std::floor(displacement.x / domain.size + 0.5f);
+	displacement.y -= domain.size * std::floor(displacement.y / domain.size + 0.5f);
+	return displacement;
+}
+
+Vector2 getPeriodicPull(const PeriodicDomain& domain, Vector2 r, float strength)
+{
+	float distanceSquared = r.x * r.x + r.y * r.y;
+	Vector2 pull = distanceSquared > 0 ? r * (strength / distanceSquared) : Vector2{ 0, 0 };
+
+	if (!domain.isEnabled)
+		return pull;
+
+	// The correction is odd in the displacement along its own axis and even
+	// along the other, so the table only covers one quadrant
+	float u = std::fabs(r.x) / domain.size * (2 * TABLE_SIZE);
+	float v = std::fabs(r.y) / domain.size * (2 * TABLE_SIZE);
+	int column = std::min(static_cast<int>(u), TABLE_SIZE - 1);
+	int row = std::min(static_cast<int>(v), TABLE_SIZE - 1);
+	float fx = std::min(u - column, 1.0f);
+	float fy = std::min(v - row, 1.0f);
+
+	const Vector2* values = getEwaldTable().values.data() + row * (TABLE_SIZE + 1) + column;
+	Vector2 correction = (values[0] * (1 - fx) + values[1] * fx) * (1 - fy) + (values[TABLE_SIZE + 1] * (1 - fx) + values[TABLE_SIZE + 2] * fx) * fy;
+
+	float scale = strength / domain.size;
+	pull.x += (r.x < 0 ? -correction.x : correction.x) * scale;
+	pull.y += (r.y < 0 ? -correction.y : correction.y) * scale;
+
+	return pull;
+}
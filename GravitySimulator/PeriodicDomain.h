@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Vector2.h"
+
+// A square box that wraps around in both axes, so a mass leaving one side
+// enters the other and feels every periodic image of every other mass.
+// A disabled domain is the unbounded plane.
+struct PeriodicDomain {
+	bool isEnabled = false;
+	Vector2 origin = { 0, 0 }; // Lower corner [km]
+	float size = 1; // Side length [km]
+};
+
+// Moves a position into the box
+Vector2 wrapPosition(const PeriodicDomain&, Vector2 position);
+
+// Shortest displacement between the images of two points, each axis within
+// half a box
+Vector2 getNearestImage(const PeriodicDomain&, Vector2 displacement);
+
+// Pull towards a source of strength G m at nearest-image displacement r from
+// the target, summed over the source's periodic images with a uniform
+// neutralizing background. The sum beyond the nearest image comes from an
+// Ewald table, so the cost is one bilinear lookup on top of the usual kernel.
+Vector2 getPeriodicPull(const PeriodicDomain&, Vector2 displacement, float strength);
@@ -0,0 +1,455 @@
+#include <algorithm>
+#include <cmath>
+
+#include "FrameArena.h"
+#include "PmForceEngine.h"
+#include "Profiler.h"
+
+// Global Constants
+namespace {
+
+	const int MIN_MESH_SIZE = 16;
+	const int MAX_MESH_SIZE = 4096;
+	const int GRAIN_SIZE = 4096; // Bodies per parallel task
+	const int ROW_GRAIN_SIZE = 4; // Mesh rows per parallel task
+
+	// Mean of log(r) over a unit square centered on the origin, used for the
+	// Green's function's own cell in place of log(0)
+	const double SELF_CELL_LOG = -1.0611754;
+
+};
+
+// Local functions
+namespace {
+
+int wrap(int index, int size)
+{
+	return ((index % size) + size) % size;
+}
+
+};
+
+PmForceEngine::PmForceEngine(int meshSize, MeshBoundary boundary) :
+	m_meshSize(0), m_boundary(boundary), m_splitRadius(0), m_grid(nullptr), m_accelerationX(nullptr), m_accelerationY(nullptr),
+	m_rowStart(nullptr), m_rowBodies(nullptr), m_bodyRows(nullptr), m_spacing(1)
+{
+	m_origin = { 0, 0 };
+	setMeshSize(meshSize);
+}
+
+const char* PmForceEngine::name() const
+{
+	return "Particle mesh";
+}
+
+int PmForceEngine::meshSize() const
+{
+	return m_meshSize;
+}
+
+void PmForceEngine::setMeshSize(int meshSize)
+{
+	int size = MIN_MESH_SIZE;
+	while (size < meshSize && size < MAX_MESH_SIZE) {
+		size *= 2;
+	}
+
+	if (size == m_meshSize)
+		return;
+
+	m_meshSize = size;
+	m_plan = FftPlan(gridSize());
+	m_greens.clear();
+}
+
+MeshBoundary PmForceEngine::boundary() const
+{
+	return m_boundary;
+}
+
+void PmForceEngine::setBoundary(MeshBoundary boundary)
+{
+	if (boundary == m_boundary)
+		return;
+
+	m_boundary = boundary;
+	m_plan = FftPlan(gridSize());
+	m_greens.clear();
+}
+
+float PmForceEngine::splitRadius() const
+{
+	return m_splitRadius;
+}
+
+void PmForceEngine::setSplitRadius(float cells)
+{
+	if (cells == m_splitRadius)
+		return;
+
+	m_splitRadius = cells;
+	m_greens.clear();
+}
+
+float PmForceEngine::spacing() const
+{
+	return m_spacing;
+}
+
+bool PmForceEngine::supportsPeriodic() const
+{
+	return true;
+}
+
+void PmForceEngine::setDomain(const PeriodicDomain& domain)
+{
+	bool wasMeshPeriodic = isMeshPeriodic();
+	ForceEngine::setDomain(domain);
+
+	if (isMeshPeriodic() != wasMeshPeriodic) {
+		m_plan = FftPlan(gridSize());
+		m_greens.clear();
+	}
+}
+
+bool PmForceEngine::isMeshPeriodic() const
+{
+	return m_domain.isEnabled || m_boundary == MeshBoundary::Periodic;
+}
+
+int PmForceEngine::gridSize() const
+{
+	return isMeshPeriodic() ? m_meshSize : 2 * m_meshSize;
+}
+
+void PmForceEngine::computeAccelerations(std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	if (masses.empty())
+		return;
+
+	// A source with no other source would only feel its own cloud-in-cell
+	// self-force, which grows without bound as the mesh shrinks around it
+	int source = -1;
+	int sourceCount = 0;
+	for (int i = 0; i < static_cast<int>(masses.size()) && sourceCount < 2; i++) {
+		if (!masses[i].doIgnore) {
+			source = i;
+			sourceCount++;
+		}
+	}
+
+	if (sourceCount == 0 || (sourceCount == 1 && masses.size() == 1)) {
+		for (Mass& mass : masses) {
+			mass.acceleration = { 0, 0 };
+		}
+		return;
+	}
+
+	placeMesh(masses);
+
+	// Given back at the end, so repeated calls in a frame reuse the space
+	FrameArena& arena = getFrameArena();
+	FrameArena::Marker marker = arena.mark();
+
+	std::size_t nodeCount = static_cast<std::size_t>(m_meshSize) * m_meshSize;
+	m_grid = arena.allocateArray<std::complex<float>>(static_cast<std::size_t>(gridSize()) * gridSize());
+	m_accelerationX = arena.allocateArray<float>(nodeCount);
+	m_accelerationY = arena.allocateArray<float>(nodeCount);
+	m_rowStart = arena.allocateArray<int>(m_meshSize + 1);
+	m_rowBodies = arena.allocateArray<int>(masses.size());
+	m_bodyRows = arena.allocateArray<int>(masses.size());
+
+	if (m_greens.empty()) {
+		PROFILE_SCOPE("Green's function");
+		computeGreens(threadPool);
+	}
+
+	{
+		PROFILE_SCOPE("Deposit");
+		deposit(masses, threadPool);
+	}
+
+	{
+		PROFILE_SCOPE("Poisson solve");
+		solve(threadPool);
+	}
+
+	{
+		PROFILE_SCOPE("Gradient");
+		differentiate(threadPool);
+	}
+
+	{
+		PROFILE_SCOPE("Interpolate");
+		interpolate(masses, threadPool);
+	}
+
+	arena.rewind(marker);
+
+	// Ignored bodies still feel a lone source
+	if (sourceCount == 1) {
+		masses[source].acceleration = { 0, 0 };
+	}
+}
+
+// Fits the mesh's square to the scene, or to the box of a periodic domain.
+// Isolated meshes keep a border of nodes so every cloud-in-cell and
+// difference stencil stays inside.
+void PmForceEngine::placeMesh(const std::vector<Mass>& masses)
+{
+	Vector2 minimum = masses[0].position;
+	Vector2 maximum = masses[0].position;
+
+	for (const Mass& mass : masses) {
+		minimum.x = std::min(minimum.x, mass.position.x);
+		minimum.y = std::min(minimum.y, mass.position.y);
+		maximum.x = std::max(maximum.x, mass.position.x);
+		maximum.y = std::max(maximum.y, mass.position.y);
+	}
+
+	float extent = std::max(maximum.x - minimum.x, maximum.y - minimum.y) * 1.0001f + 0.001f;
+
+	if (m_domain.isEnabled) {
+		m_spacing = m_domain.size / m_meshSize;
+		m_origin = m_domain.origin;
+	}
+	else if (m_boundary == MeshBoundary::Isolated) {
+		m_spacing = extent / (m_meshSize - 4);
+		m_origin = { minimum.x - m_spacing, minimum.y - m_spacing };
+	}
+	else {
+		m_spacing = extent / m_meshSize;
+		m_origin = minimum;
+	}
+}
+
+// The Green's function depends only on the mesh, since a change of spacing
+// only adds a constant to the logarithmic potential
+void PmForceEngine::computeGreens(ThreadPool& threadPool)
+{
+	int size = gridSize();
+	m_greens.assign(static_cast<std::size_t>(size) * size, 0.0f);
+
+	for (int row = 0; row < size; row++) {
+		int dy = std::min(row, size - row);
+
+		for (int column = 0; column < size; column++) {
+			int dx = std::min(column, size - column);
+			double value;
+
+			if (!isMeshPeriodic()) {
+				// Potential of a unit mass, G log(r), at every offset
+				value = GRAVITATIONAL_CONSTANT * (dx == 0 && dy == 0 ? SELF_CELL_LOG : 0.5 * std::log(static_cast<double>(dx * dx + dy * dy)));
+			}
+			else {
+				// Already in frequency space: the Laplacian's inverse, with
+				// the mean density removed
+				double kx = 2 * M_PI * dx / size;
+				double ky = 2 * M_PI * dy / size;
+				double kSquared = kx * kx + ky * ky;
+				value = kSquared > 0 ? -2 * M_PI * GRAVITATIONAL_CONSTANT / kSquared : 0.0;
+			}
+
+			m_greens[static_cast<std::size_t>(row) * size + column] = static_cast<float>(value);
+		}
+	}
+
+	if (!isMeshPeriodic()) {
+		m_plan.transform2d(m_greens.data(), false, threadPool);
+	}
+
+	if (m_splitRadius <= 0)
+		return;
+
+	// Long-range filter. The cloud-in-cell smoothing, applied once when
+	// depositing and once when interpolating, is divided back out, which is
+	// safe because the filter has already removed the short wavelengths.
+	double splitRadiusSquared = static_cast<double>(m_splitRadius) * m_splitRadius;
+
+	for (int row = 0; row < size; row++) {
+		double ky = 2 * M_PI * std::min(row, size - row) / size;
+		double sincY = ky > 0 ? std::sin(ky / 2) / (ky / 2) : 1.0;
+
+		for (int column = 0; column < size; column++) {
+			double kx = 2 * M_PI * std::min(column, size - column) / size;
+			double sincX = kx > 0 ? std::sin(kx / 2) / (kx / 2) : 1.0;
+
+			double window = sincX * sincX * sincY * sincY;
+			double filter = std::exp(-(kx * kx + ky * ky) * splitRadiusSquared) / (window * window);
+
+			m_greens[static_cast<std::size_t>(row) * size + column] *= static_cast<float>(filter);
+		}
+	}
+}
+
+void PmForceEngine::deposit(const std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	int count = static_cast<int>(masses.size());
+	int meshSize = m_meshSize;
+	int size = gridSize();
+	bool isPeriodic = isMeshPeriodic();
+	float inverseSpacing = 1 / m_spacing;
+
+	// Sort bodies by the mesh row below them. The sort is stable, so each
+	// row sums its bodies in index order.
+	threadPool.parallelFor(count, GRAIN_SIZE, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			int row = static_cast<int>(std::floor((masses[i].position.y - m_origin.y) * inverseSpacing));
+			m_bodyRows[i] = isPeriodic ? wrap(row, meshSize) : row;
+		}
+	});
+
+	std::fill(m_rowStart, m_rowStart + meshSize + 1, 0);
+	for (int i = 0; i < count; i++) {
+		m_rowStart[m_bodyRows[i] + 1]++;
+	}
+	for (int row = 0; row < meshSize; row++) {
+		m_rowStart[row + 1] += m_rowStart[row];
+	}
+
+	for (int i = 0; i < count; i++) {
+		m_rowBodies[m_rowStart[m_bodyRows[i]]++] = i;
+	}
+	for (int row = meshSize; row > 0; row--) {
+		m_rowStart[row] = m_rowStart[row - 1];
+	}
+	m_rowStart[0] = 0;
+
+	std::fill(m_grid, m_grid + static_cast<std::size_t>(size) * size, std::complex<float>(0));
+
+	// Each mesh row gathers the bodies in its own row and the row below
+	threadPool.parallelFor(meshSize, ROW_GRAIN_SIZE, [&](int begin, int end) {
+		for (int row = begin; row < end; row++) {
+			std::complex<float>* line = m_grid + static_cast<std::size_t>(row) * size;
+
+			for (int pass = 0; pass < 2; pass++) {
+				int sourceRow = pass == 0 ? row - 1 : row;
+				if (isPeriodic)
+					sourceRow = wrap(sourceRow, meshSize);
+				else if (sourceRow < 0)
+					continue;
+
+				for (int b = m_rowStart[sourceRow]; b < m_rowStart[sourceRow + 1]; b++) {
+					const Mass& mass = masses[m_rowBodies[b]];
+					if (mass.doIgnore)
+						continue;
+
+					float u = (mass.position.x - m_origin.x) * inverseSpacing;
+					float v = (mass.position.y - m_origin.y) * inverseSpacing;
+					int column = static_cast<int>(std::floor(u));
+					float fx = u - column;
+					float fy = v - std::floor(v);
+
+					float weight = mass.mass * (pass == 0 ? fy : 1 - fy);
+					int right = column + 1;
+					if (isPeriodic) {
+						column = wrap(column, meshSize);
+						right = wrap(right, meshSize);
+					}
+
+					line[column] += weight * (1 - fx);
+					line[right] += weight * fx;
+				}
+			}
+		}
+	});
+}
+
+void PmForceEngine::solve(ThreadPool& threadPool)
+{
+	int size = gridSize();
+	std::size_t cellCount = static_cast<std::size_t>(size) * size;
+	float normalization = 1.0f / cellCount;
+
+	m_plan.transform2d(m_grid, false, threadPool);
+
+	threadPool.parallelFor(size, ROW_GRAIN_SIZE, [&](int begin, int end) {
+		for (std::size_t i = static_cast<std::size_t>(begin) * size; i < static_cast<std::size_t>(end) * size; i++) {
+			m_grid[i] *= m_greens[i] * normalization;
+		}
+	});
+
+	m_plan.transform2d(m_grid, true, threadPool);
+}
+
+// Central differences of the potential, a = -grad phi
+void PmForceEngine::differentiate(ThreadPool& threadPool)
+{
+	int meshSize = m_meshSize;
+	int size = gridSize();
+	bool isPeriodic = isMeshPeriodic();
+	float scale = -0.5f / m_spacing;
+
+	std::fill(m_accelerationX, m_accelerationX + static_cast<std::size_t>(meshSize) * meshSize, 0.0f);
+	std::fill(m_accelerationY, m_accelerationY + static_cast<std::size_t>(meshSize) * meshSize, 0.0f);
+
+	auto potential = [&](int column, int row) {
+		return m_grid[static_cast<std::size_t>(row) * size + column].real();
+	};
+
+	threadPool.parallelFor(meshSize, ROW_GRAIN_SIZE, [&](int begin, int end) {
+		for (int row = begin; row < end; row++) {
+			// Isolated meshes leave their outermost nodes at zero; no body reaches them
+			if (!isPeriodic && (row == 0 || row == meshSize - 1))
+				continue;
+
+			int below = isPeriodic ? wrap(row - 1, meshSize) : row - 1;
+			int above = isPeriodic ? wrap(row + 1, meshSize) : row + 1;
+
+			for (int column = 0; column < meshSize; column++) {
+				if (!isPeriodic && (column == 0 || column == meshSize - 1))
+					continue;
+
+				int left = isPeriodic ? wrap(column - 1, meshSize) : column - 1;
+				int right = isPeriodic ? wrap(column + 1, meshSize) : column + 1;
+
+				std::size_t node = static_cast<std::size_t>(row) * meshSize + column;
+				m_accelerationX[node] = scale * (potential(right, row) - potential(left, row));
+				m_accelerationY[node] = scale * (potential(column, above) - potential(column, below));
+			}
+		}
+	});
+}
+
+void PmForceEngine::interpolate(std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	int meshSize = m_meshSize;
+	bool isPeriodic = isMeshPeriodic();
+	float inverseSpacing = 1 / m_spacing;
+
+	threadPool.parallelFor(static_cast<int>(masses.size()), GRAIN_SIZE, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			float u = (masses[i].position.x - m_origin.x) * inverseSpacing;
+			float v = (masses[i].position.y - m_origin.y) * inverseSpacing;
+			int column = static_cast<int>(std::floor(u));
+			int row = static_cast<int>(std::floor(v));
+			float fx = u - column;
+			float fy = v - row;
+
+			int right = column + 1;
+			int above = row + 1;
+			if (isPeriodic) {
+				column = wrap(column, meshSize);
+				right = wrap(right, meshSize);
+				row = wrap(row, meshSize);
+				above = wrap(above, meshSize);
+			}
+
+			std::size_t nodes[4] = {
+				static_cast<std::size_t>(row) * meshSize + column,
+				static_cast<std::size_t>(row) * meshSize + right,
+				static_cast<std::size_t>(above) * meshSize + column,
+				static_cast<std::size_t>(above) * meshSize + right,
+			};
+			float weights[4] = { (1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy };
+
+			Vector2 acceleration = { 0, 0 };
+			for (int k = 0; k < 4; k++) {
+				acceleration.x += weights[k] * m_accelerationX[nodes[k]];
+				acceleration.y += weights[k] * m_accelerationY[nodes[k]];
+			}
+
+			masses[i].acceleration = acceleration;
+		}
+	});
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+#include "Fft.h"
+#include "ForceEngine.h"
+
+enum class MeshBoundary {
+	Isolated, // Zero-padded to twice the mesh, so there are no periodic images
+	Periodic, // The mesh's square is one tile of an infinite periodic plane
+};
+
+// Particle-mesh solver: masses are spread onto a square mesh around the
+// scene with cloud-in-cell weights, the potential is found with an FFT
+// Poisson solve, and its finite-difference gradient is interpolated back to
+// each body with the same weights. Cost is linear in the bodies plus
+// M^2 log M in the mesh, but forces are smoothed below a few mesh cells.
+class PmForceEngine : public ForceEngine {
+public:
+	explicit PmForceEngine(int meshSize = 256, MeshBoundary = MeshBoundary::Isolated);
+
+	const char* name() const final;
+	bool supportsPeriodic() const final;
+	void setDomain(const PeriodicDomain&) final;
+
+	void computeAccelerations(std::vector<Mass>&, ThreadPool&) final;
+
+	int meshSize() const;
+	void setMeshSize(int); // Rounded up to a power of two
+	// Ignored in a periodic domain, where the mesh always covers the box
+	MeshBoundary boundary() const;
+	void setBoundary(MeshBoundary);
+
+	// Keeps only forces on scales above the split radius, in mesh cells, by
+	// filtering the Green's function with exp(-k^2 r_s^2). The rest is left to
+	// a short-range solver. 0 keeps the whole force.
+	float splitRadius() const;
+	void setSplitRadius(float cells);
+
+	float spacing() const; // Between mesh nodes in world space, as of the last computation
+
+private:
+	int m_meshSize;
+	MeshBoundary m_boundary;
+	float m_splitRadius;
+
+	FftPlan m_plan; // Over the padded grid for isolated boundaries
+	std::vector<std::complex<float>> m_greens; // Transformed Green's function, empty until needed
+
+	// Scratch in the calling thread's frame arena, only valid during computeAccelerations
+	std::complex<float>* m_grid; // Density, then potential
+	float* m_accelerationX; // At mesh nodes
+	float* m_accelerationY;
+
+	// Bodies sorted by mesh row, so each row can be deposited by one task
+	int* m_rowStart;
+	int* m_rowBodies;
+	int* m_bodyRows;
+
+	// Mesh node (0, 0) in world space, and the node spacing
+	Vector2 m_origin;
+	float m_spacing;
+
+	bool isMeshPeriodic() const;
+	int gridSize() const;
+	void placeMesh(const std::vector<Mass>&);
+	void computeGreens(ThreadPool&);
+	void deposit(const std::vector<Mass>&, ThreadPool&);
+	void solve(ThreadPool&);
+	void differentiate(ThreadPool&);
+	void interpolate(std::vector<Mass>&, ThreadPool&);
+};
@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <mutex>
+
+#include "imgui/imgui.h"
+
+#include "AllocationTracker.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
+#include "Trace.h"
+
+// Global Constants
+namespace {
+
+	const int MAX_SCOPES = 64;
+	const int MAX_COUNTERS = 16;
+	const int HISTORY_LENGTH = 240; // Frames
+
+};
+
+// Local state and functions
+namespace {
+
+	struct ScopeRecord {
+		const char* name;
+		int depth; // Nesting depth the first time the scope was entered
+		double frameTime; // Seconds accumulated in the current frame
+		bool isFrameSkipped; // No sample this frame, stored as NaN and left out of statistics
+		float history[HISTORY_LENGTH]; // Milliseconds per frame
+		std::uint64_t frameAllocations; // Heap allocations made inside the scope this frame
+		float allocationHistory[HISTORY_LENGTH];
+		std::atomic<std::uint64_t> hardwareTotals[HARDWARE_COUNTER_COUNT]; // Summed over every thread
+	};
+
+	struct CounterRecord {
+		const char* name;
+		double value;
+	};
+
+	struct ScopeStatistics {
+		float minimum, average, p99;
+	};
+
+	ScopeRecord scopes[MAX_SCOPES];
+	std::atomic<int> scopeCount(0); // Published after the record is filled in
+
+	CounterRecord counters[MAX_COUNTERS];
+	std::atomic<int> counterCount(0);
+
+	float frameHistory[HISTORY_LENGTH];
+	float frameAllocationHistory[HISTORY_LENGTH]; // On every thread
+	std::uint64_t frameStartAllocations = 0;
+	int historyHead = 0; // Next slot to be written
+	int historySize = 0;
+
+	std::chrono::steady_clock::time_point frameStart;
+	int hardwareFrameCount = 0; // Frames covered by the hardware totals
+
+	std::mutex registrationMutex;
+	thread_local bool isFrameThread = false; // Set on the thread running the main loop
+	thread_local int scopeDepth = 0;
+
+	enum class TraceSaveResult { None, Saved, Failed };
+	TraceSaveResult lastTraceSave = TraceSaveResult::None; // Shown next to the button
+
+	ScopeStatistics getStatistics(const float* history)
+	{
+		float sorted[HISTORY_LENGTH];
+		int sampleCount = 0;
+		double sum = 0;
+
+		for (int i = 0; i < historySize; i++) {
+			if (std::isnan(history[i]))
+				continue;
+
+			sorted[sampleCount++] = history[i];
+			sum += history[i];
+		}
+
+		ScopeStatistics statistics = { 0, 0, 0 };
+		if (sampleCount == 0)
+			return statistics;
+
+		int p99Index = std::max(0, (sampleCount * 99 + 99) / 100 - 1);
+		std::nth_element(sorted, sorted + p99Index, sorted + sampleCount);
+
+		statistics.minimum = *std::min_element(sorted, sorted + sampleCount);
+		statistics.average = static_cast<float>(sum / sampleCount);
+		statistics.p99 = sorted[p99Index];
+
+		return statistics;
+	}
+
+	double getHardwarePerFrame(const ScopeRecord& scope, int counter)
+	{
+		if (hardwareFrameCount == 0)
+			return 0;
+
+		return static_cast<double>(scope.hardwareTotals[counter].load(std::memory_order_relaxed)) / hardwareFrameCount;
+	}
+
+	double getInstructionsPerCycle(const ScopeRecord& scope)
+	{
+		double cycles = getHardwarePerFrame(scope, HARDWARE_CYCLES);
+		return cycles > 0 ? getHardwarePerFrame(scope, HARDWARE_INSTRUCTIONS) / cycles : 0;
+	}
+
+	void resetHardwareTotals()
+	{
+		for (int i = 0; i < scopeCount.load(std::memory_order_acquire); i++) {
+			for (int counter = 0; counter < HARDWARE_COUNTER_COUNT; counter++) {
+				scopes[i].hardwareTotals[counter].store(0, std::memory_order_relaxed);
+			}
+		}
+
+		hardwareFrameCount = 0;
+	}
+
+};
+
+int registerProfileScope(const char* name)
+{
+	std::lock_guard<std::mutex> lock(registrationMutex);
+
+	int index = scopeCount.load(std::memory_order_relaxed);
+	if (index == MAX_SCOPES)
+		return -1;
+
+	ScopeRecord& scope = scopes[index];
+	scope.name = name;
+	scope.depth = scopeDepth;
+	scope.frameTime = 0;
+	scope.isFrameSkipped = false;
+	std::fill(scope.history, scope.history + HISTORY_LENGTH, 0.0f);
+	scope.frameAllocations = 0;
+	std::fill(scope.allocationHistory, scope.allocationHistory + HISTORY_LENGTH, 0.0f);
+	for (int counter = 0; counter < HARDWARE_COUNTER_COUNT; counter++) {
+		scope.hardwareTotals[counter].store(0, std::memory_order_relaxed);
+	}
+
+	scopeCount.store(index + 1, std::memory_order_release);
+
+	return index;
+}
+
+int registerProfileCounter(const char* name)
+{
+	std::lock_guard<std::mutex> lock(registrationMutex);
+
+	int index = counterCount.load(std::memory_order_relaxed);
+	if (index == MAX_COUNTERS)
+		return -1;
+
+	counters[index].name = name;
+	counters[index].value = 0;
+	counterCount.store(index + 1, std::memory_order_release);
+
+	return index;
+}
+
+void addProfileScopeTime(int scope, double seconds)
+{
+	// Per-frame aggregation is only kept for the main loop's thread
+	if (scope >= 0 && isFrameThread)
+		scopes[scope].frameTime += seconds;
+}
+
+void skipProfileScopeFrame(int scope)
+{
+	if (scope >= 0 && isFrameThread)
+		scopes[scope].isFrameSkipped = true;
+}
+
+void setProfileCounter(int counter, double value)
+{
+	if (counter >= 0)
+		counters[counter].value = value;
+}
+
+void beginProfileFrame()
+{
+	isFrameThread = true;
+	frameStart = std::chrono::steady_clock::now();
+	frameStartAllocations = getTotalAllocationCount();
+
+	// Scopes entered between frames (such as program loading) are discarded
+	for (int i = 0; i < scopeCount.load(std::memory_order_acquire); i++) {
+		scopes[i].frameTime = 0;
+		scopes[i].isFrameSkipped = false;
+		scopes[i].frameAllocations = 0;
+	}
+}
+
+void endProfileFrame()
+{
+	frameHistory[historyHead] = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+	frameAllocationHistory[historyHead] = static_cast<float>(getTotalAllocationCount() - frameStartAllocations);
+
+	for (int i = 0; i < scopeCount.load(std::memory_order_acquire); i++) {
+		scopes[i].history[historyHead] = scopes[i].isFrameSkipped ? std::numeric_limits<float>::quiet_NaN() : static_cast<float>(scopes[i].frameTime * 1000.0);
+		scopes[i].frameTime = 0;
+		scopes[i].isFrameSkipped = false;
+		scopes[i].allocationHistory[historyHead] = static_cast<float>(scopes[i].frameAllocations);
+		scopes[i].frameAllocations = 0;
+	}
+
+	historyHead = (historyHead + 1) % HISTORY_LENGTH;
+	historySize = std::min(historySize + 1, HISTORY_LENGTH);
+
+	if (areHardwareCountersEnabled())
+		hardwareFrameCount++;
+}
+
+void addProfileScopeAllocations(int scope, std::uint64_t allocations)
+{
+	if (scope >= 0 && isFrameThread)
+		scopes[scope].frameAllocations += allocations;
+}
+
+void addProfileScopeHardwareCounts(int scope, const HardwareCounts& counts)
+{
+	if (scope < 0)
+		return;
+
+	for (int counter = 0; counter < HARDWARE_COUNTER_COUNT; counter++) {
+		scopes[scope].hardwareTotals[counter].fetch_add(counts.values[counter], std::memory_order_relaxed);
+	}
+}
+
+void drawImGuiProfiler(const char* tracePath)
+{
+	ImGui::SetNextWindowCollapsed(true, ImGuiCond_FirstUseEver);
+	ImGui::Begin("Profiler");
+
+	bool isTracing = isTracingEnabled();
+	if (ImGui::Checkbox("Record trace", &isTracing)) {
+		setTracingEnabled(isTracing);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Save trace")) {
+		lastTraceSave = writeTrace(tracePath) ? TraceSaveResult::Saved : TraceSaveResult::Failed;
+	}
+	ImGui::SameLine();
+	if (lastTraceSave == TraceSaveResult::Failed)
+		ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Failed to write %s", tracePath);
+	else if (lastTraceSave == TraceSaveResult::Saved)
+		ImGui::TextDisabled("Saved %s", tracePath);
+	else
+		ImGui::TextDisabled("%s", tracePath);
+
+	bool isCounting = areHardwareCountersEnabled();
+	if (ImGui::Checkbox("Hardware counters", &isCounting)) {
+		setHardwareCountersEnabled(isCounting);
+		resetHardwareTotals();
+	}
+	if (isCounting && getHardwareCountersError() != nullptr) {
+		ImGui::SameLine();
+		ImGui::TextDisabled("Unavailable: %s", getHardwareCountersError());
+		isCounting = false;
+	}
+
+	ScopeStatistics frame = getStatistics(frameHistory);
+	ImGui::Text("Frame: %.2f ms avg, %.2f ms p99 (%.0f FPS)", frame.average, frame.p99, frame.average > 0 ? 1000.0f / frame.average : 0.0f);
+
+	bool isTrackingAllocations = isAllocationTrackingEnabled();
+	if (isTrackingAllocations) {
+		ScopeStatistics frameAllocations = getStatistics(frameAllocationHistory);
+		ImGui::Text("Heap allocations: %.1f per frame avg, %.0f p99", frameAllocations.average, frameAllocations.p99);
+	}
+
+	// Unroll the ring so the graph scrolls from oldest to newest
+	float graph[HISTORY_LENGTH];
+	for (int i = 0; i < historySize; i++) {
+		graph[i] = frameHistory[(historyHead - historySize + i + HISTORY_LENGTH) % HISTORY_LENGTH];
+	}
+	ImGui::PlotLines("##Frame time", graph, historySize, 0, "Frame time [ms]", 0.0f, std::max(frame.p99 * 1.5f, 1.0f), ImVec2(0, 60));
+
+	int columnCount = 4 + (isTrackingAllocations ? 2 : 0) + (isCounting ? 3 : 0);
+
+	if (ImGui::BeginTable("Scopes", columnCount, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+		ImGui::TableSetupColumn("Scope");
+		ImGui::TableSetupColumn("Min [ms]");
+		ImGui::TableSetupColumn("Avg [ms]");
+		ImGui::TableSetupColumn("p99 [ms]");
+		if (isTrackingAllocations) {
+			ImGui::TableSetupColumn("Allocs avg");
+			ImGui::TableSetupColumn("Allocs p99");
+		}
+		if (isCounting) {
+			ImGui::TableSetupColumn("IPC");
+			ImGui::TableSetupColumn("Cache misses/frame");
+			ImGui::TableSetupColumn("Branch misses/frame");
+		}
+		ImGui::TableHeadersRow();
+
+		for (int i = 0; i < scopeCount.load(std::memory_order_acquire); i++) {
+			ScopeStatistics statistics = getStatistics(scopes[i].history);
+
+			ImGui::TableNextColumn();
+			if (scopes[i].depth > 0)
+				ImGui::Indent(scopes[i].depth * 10.0f);
+			ImGui::TextUnformatted(scopes[i].name);
+			if (scopes[i].depth > 0)
+				ImGui::Unindent(scopes[i].depth * 10.0f);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", statistics.minimum);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", statistics.average);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", statistics.p99);
+
+			if (isTrackingAllocations) {
+				ScopeStatistics allocations = getStatistics(scopes[i].allocationHistory);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", allocations.average);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f", allocations.p99);
+			}
+
+			if (isCounting) {
+				ImGui::TableNextColumn();
+				ImGui::Text("%.2f", getInstructionsPerCycle(scopes[i]));
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f", getHardwarePerFrame(scopes[i], HARDWARE_CACHE_MISSES));
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f", getHardwarePerFrame(scopes[i], HARDWARE_BRANCH_MISSES));
+			}
+		}
+
+		ImGui::EndTable();
+	}
+
+	for (int i = 0; i < counterCount.load(std::memory_order_acquire); i++) {
+		ImGui::Text("%s: %.0f", counters[i].name, counters[i].value);
+	}
+
+	ImGui::End();
+}
+
+void printProfileSummary()
+{
+	ScopeStatistics frame = getStatistics(frameHistory);
+
+	std::printf("Profile of the last %d frames\n", historySize);
+	std::printf("%-24s %10s %10s %10s\n", "scope", "min [ms]", "avg [ms]", "p99 [ms]");
+	std::printf("%-24s %10.3f %10.3f %10.3f\n", "Frame", frame.minimum, frame.average, frame.p99);
+
+	for (int i = 0; i < scopeCount.load(std::memory_order_acquire); i++) {
+		ScopeStatistics statistics = getStatistics(scopes[i].history);
+		std::printf("%*s%-*s %10.3f %10.3f %10.3f\n", 2 * scopes[i].depth, "", 24 - 2 * scopes[i].depth, scopes[i].name, statistics.minimum, statistics.average, statistics.p99);
+	}
+
+	for (int i = 0; i < counterCount.load(std::memory_order_acquire); i++) {
+		std::printf("%s: %.0f\n", counters[i].name, counters[i].value);
+	}
+
+	if (isAllocationTrackingEnabled()) {
+		ScopeStatistics frameAllocations = getStatistics(frameAllocationHistory);
+
+		std::printf("\nHeap allocations per frame\n");
+		std::printf("%-24s %10s %10s\n", "scope", "avg", "p99");
+		std::printf("%-24s %10.1f %10.0f\n", "Frame", frameAllocations.average, frameAllocations.p99);
+
+		for (int i = 0; i < scopeCount.load(std::memory_order_acquire); i++) {
+			ScopeStatistics allocations = getStatistics(scopes[i].allocationHistory);
+			std::printf("%*s%-*s %10.1f %10.0f\n", 2 * scopes[i].depth, "", 24 - 2 * scopes[i].depth, scopes[i].name, allocations.average, allocations.p99);
+		}
+	}
+
+	if (areHardwareCountersEnabled()) {
+		if (getHardwareCountersError() != nullptr) {
+			std::printf("Hardware counters unavailable: %s\n", getHardwareCountersError());
+			return;
+		}
+
+		std::printf("\nHardware counters over %d frames\n", hardwareFrameCount);
+		std::printf("%-24s %10s %14s %14s\n", "scope", "IPC", "cache miss/fr", "branch miss/fr");
+
+		for (int i = 0; i < scopeCount.load(std::memory_order_acquire); i++) {
+			std::printf("%*s%-*s %10.2f %14.0f %14.0f\n", 2 * scopes[i].depth, "", 24 - 2 * scopes[i].depth, scopes[i].name,
+				getInstructionsPerCycle(scopes[i]), getHardwarePerFrame(scopes[i], HARDWARE_CACHE_MISSES), getHardwarePerFrame(scopes[i], HARDWARE_BRANCH_MISSES));
+		}
+	}
+}
+
+ProfileScope::ProfileScope(int scope) : m_scope(scope)
+{
+	scopeDepth++;
+
+	m_allocationStart = getThreadAllocationCount();
+	m_hasHardwareCounts = readHardwareCounters(m_hardwareStart);
+	m_start = std::chrono::steady_clock::now();
+}
+
+ProfileScope::~ProfileScope()
+{
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	HardwareCounts hardwareEnd;
+	if (m_hasHardwareCounts && readHardwareCounters(hardwareEnd)) {
+		for (int counter = 0; counter < HARDWARE_COUNTER_COUNT; counter++) {
+			hardwareEnd.values[counter] -= m_hardwareStart.values[counter];
+		}
+		addProfileScopeHardwareCounts(m_scope, hardwareEnd);
+	}
+
+	scopeDepth--;
+
+	if (m_scope >= 0) {
+		addProfileScopeTime(m_scope, std::chrono::duration<double>(end - m_start).count());
+		addProfileScopeAllocations(m_scope, getThreadAllocationCount() - m_allocationStart);
+		recordTraceEvent(scopes[m_scope].name, m_start, end);
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "PerfCounters.h"
+
+// Lightweight frame profiler. Scopes are registered once per call site and
+// their wall-clock time is summed per frame on the main thread, so a marker
+// costs two clock reads and an addition. The last few seconds of frames are
+// kept for the min/avg/p99 overlay. While tracing is enabled, every scope on
+// every thread is also recorded as a trace event (see Trace.h), and while
+// hardware counters are enabled their deltas are summed per scope. Debug
+// builds also count heap allocations per scope (see AllocationTracker.h).
+
+int registerProfileScope(const char* name);
+int registerProfileCounter(const char* name);
+
+void addProfileScopeTime(int scope, double seconds);
+// Leaves the scope out of this frame's statistics instead of counting 0 ms
+void skipProfileScopeFrame(int scope);
+void addProfileScopeAllocations(int scope, std::uint64_t allocations);
+void addProfileScopeHardwareCounts(int scope, const HardwareCounts&);
+void setProfileCounter(int counter, double value);
+
+void beginProfileFrame();
+void endProfileFrame();
+
+void drawImGuiProfiler(const char* tracePath);
+void printProfileSummary();
+
+class ProfileScope {
+public:
+	explicit ProfileScope(int scope);
+	~ProfileScope();
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	int m_scope;
+	std::chrono::steady_clock::time_point m_start;
+	std::uint64_t m_allocationStart;
+	bool m_hasHardwareCounts;
+	HardwareCounts m_hardwareStart;
+};
+
+#define PROFILE_CONCATENATE_INNER(a, b) a##b
+#define PROFILE_CONCATENATE(a, b) PROFILE_CONCATENATE_INNER(a, b)
+
+// Times the rest of the enclosing block under `name`
+#define PROFILE_SCOPE(name) \
+	static const int PROFILE_CONCATENATE(profileScopeId, __LINE__) = registerProfileScope(name); \
+	ProfileScope PROFILE_CONCATENATE(profileScope, __LINE__)(PROFILE_CONCATENATE(profileScopeId, __LINE__))
+
+#define PROFILE_COUNTER(name, value) \
+	do { \
+		static const int profileCounterId = registerProfileCounter(name); \
+		setProfileCounter(profileCounterId, value); \
+	} while (false)
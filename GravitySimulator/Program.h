@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include <string>
+
 #include "Renderer.h"
 
 class Program {
@@ -11,4 +13,8 @@ public:
 	virtual void drawImGui(Renderer&) {}
 
 	virtual void mousePressed(Renderer&, SDL_MouseButtonEvent) {}
+
+	// RMS relative acceleration error of the named force engine against
+	// direct summation, for scenario checks. Negative if it cannot be measured.
+	virtual float measureForceError(const std::string& engine) { return -1; }
 };
@@ -0,0 +1,240 @@
+#include <algorithm>
+
+#include "QuadTree.h"
+
+// Global Constants
+namespace {
+
+	const int LEAF_CAPACITY = 8;
+	const int MAX_DEPTH = MortonSorter::KEY_LEVELS; // Keys cannot separate bodies any deeper
+	const int GRAIN_SIZE = 256; // Nodes per parallel task
+
+};
+
+void QuadTree::build(const std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	m_nodes.clear();
+	m_levelStart.clear();
+	m_isInvalid = false;
+	m_updatesSinceBuild = 0;
+
+	m_bodies = m_sorter.sort(masses, threadPool);
+
+	if (masses.empty())
+		return;
+
+	float halfSize = m_sorter.size() * 0.5f;
+
+	QuadTreeNode root;
+	root.center = m_sorter.origin() + Vector2{ halfSize, halfSize };
+	root.halfSize = halfSize;
+	root.firstChild = -1;
+	root.firstBody = 0;
+	root.bodyCount = static_cast<int>(masses.size());
+
+	m_nodes.push_back(root);
+	m_levelStart.push_back(0);
+	m_levelStart.push_back(1);
+
+	for (int level = 0; level < MAX_DEPTH; level++) {
+		splitLevel(level, threadPool);
+
+		if (m_levelStart.back() == static_cast<int>(m_nodes.size()))
+			break;
+
+		m_levelStart.push_back(static_cast<int>(m_nodes.size()));
+	}
+
+	summarize(masses, threadPool, false);
+}
+
+void QuadTree::refit(const std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	summarize(masses, threadPool, true);
+}
+
+void QuadTree::update(const std::vector<Mass>& masses, ThreadPool& threadPool, int rebuildInterval)
+{
+	if (m_isInvalid || masses.size() != m_bodies.size() || ++m_updatesSinceBuild >= rebuildInterval)
+		build(masses, threadPool);
+	else
+		refit(masses, threadPool);
+}
+
+void QuadTree::invalidate()
+{
+	m_isInvalid = true;
+}
+
+const std::vector<QuadTreeNode>& QuadTree::nodes() const
+{
+	return m_nodes;
+}
+
+const std::vector<int>& QuadTree::bodies() const
+{
+	return m_bodies;
+}
+
+// Gives every crowded node of the last level four children, appended as the
+// next level. Offsets are a prefix sum over the level, so the layout does not
+// depend on the thread count.
+void QuadTree::splitLevel(int level, ThreadPool& threadPool)
+{
+	int first = m_levelStart[level];
+	int last = m_levelStart[level + 1];
+	int count = last - first;
+
+	m_childOffsets.resize(count);
+
+	int childCount = 0;
+	for (int n = 0; n < count; n++) {
+		m_childOffsets[n] = childCount;
+		if (m_nodes[first + n].bodyCount > LEAF_CAPACITY)
+			childCount += 4;
+	}
+
+	if (childCount == 0)
+		return;
+
+	m_nodes.resize(last + childCount);
+
+	const std::vector<std::uint32_t>& keys = m_sorter.keys();
+	int shift = 2 * (MortonSorter::KEY_LEVELS - 1 - level);
+
+	threadPool.parallelFor(count, GRAIN_SIZE, [&](int begin, int end) {
+		for (int n = begin; n < end; n++) {
+			QuadTreeNode& node = m_nodes[first + n];
+			if (node.bodyCount <= LEAF_CAPACITY)
+				continue;
+
+			node.firstChild = last + m_childOffsets[n];
+
+			// Bodies are in key order, so each quadrant's are contiguous:
+			// bottom-left, bottom-right, top-left, top-right
+			const std::uint32_t* firstKey = keys.data() + node.firstBody;
+			const std::uint32_t* lastKey = firstKey + node.bodyCount;
+			const std::uint32_t* bounds[5];
+			bounds[0] = firstKey;
+			bounds[4] = lastKey;
+			for (int quadrant = 1; quadrant < 4; quadrant++) {
+				bounds[quadrant] = std::partition_point(bounds[quadrant - 1], lastKey, [&](std::uint32_t key) {
+					return static_cast<int>((key >> shift) & 3) < quadrant;
+				});
+			}
+
+			float childHalfSize = node.halfSize * 0.5f;
+
+			for (int quadrant = 0; quadrant < 4; quadrant++) {
+				QuadTreeNode& child = m_nodes[node.firstChild + quadrant];
+				child.center.x = node.center.x + ((quadrant & 1) ? childHalfSize : -childHalfSize);
+				child.center.y = node.center.y + ((quadrant & 2) ? childHalfSize : -childHalfSize);
+				child.halfSize = childHalfSize;
+				child.firstChild = -1;
+				child.firstBody = static_cast<int>(bounds[quadrant] - keys.data());
+				child.bodyCount = static_cast<int>(bounds[quadrant + 1] - bounds[quadrant]);
+			}
+		}
+	});
+}
+
+// Masses, centers of mass and quadrupoles, from the deepest level up.
+// Refitting also replaces each cell's square with the bounding square of its
+// bodies.
+void QuadTree::summarize(const std::vector<Mass>& masses, ThreadPool& threadPool, bool doFitBounds)
+{
+	if (doFitBounds)
+		m_bounds.resize(2 * m_nodes.size());
+
+	for (int level = static_cast<int>(m_levelStart.size()) - 2; level >= 0; level--) {
+		int first = m_levelStart[level];
+		int last = m_levelStart[level + 1];
+
+		threadPool.parallelFor(last - first, GRAIN_SIZE, [&](int begin, int end) {
+			for (int n = first + begin; n < first + end; n++) {
+				QuadTreeNode& node = m_nodes[n];
+				Vector2 minimum = node.center;
+				Vector2 maximum = node.center;
+				bool hasBounds = false;
+
+				node.mass = 0;
+				node.centerOfMass = { 0, 0 };
+
+				if (node.firstChild == -1) {
+					for (int b = node.firstBody; b < node.firstBody + node.bodyCount; b++) {
+						const Mass& mass = masses[m_bodies[b]];
+						if (!mass.doIgnore) {
+							node.mass += mass.mass;
+							node.centerOfMass += mass.position * mass.mass;
+						}
+
+						if (doFitBounds) {
+							minimum.x = hasBounds ? std::min(minimum.x, mass.position.x) : mass.position.x;
+							minimum.y = hasBounds ? std::min(minimum.y, mass.position.y) : mass.position.y;
+							maximum.x = hasBounds ? std::max(maximum.x, mass.position.x) : mass.position.x;
+							maximum.y = hasBounds ? std::max(maximum.y, mass.position.y) : mass.position.y;
+							hasBounds = true;
+						}
+					}
+				}
+				else {
+					for (int quadrant = 0; quadrant < 4; quadrant++) {
+						int c = node.firstChild + quadrant;
+						const QuadTreeNode& child = m_nodes[c];
+						node.mass += child.mass;
+						node.centerOfMass += child.centerOfMass * child.mass;
+
+						if (doFitBounds && child.bodyCount > 0) {
+							minimum.x = hasBounds ? std::min(minimum.x, m_bounds[2 * c].x) : m_bounds[2 * c].x;
+							minimum.y = hasBounds ? std::min(minimum.y, m_bounds[2 * c].y) : m_bounds[2 * c].y;
+							maximum.x = hasBounds ? std::max(maximum.x, m_bounds[2 * c + 1].x) : m_bounds[2 * c + 1].x;
+							maximum.y = hasBounds ? std::max(maximum.y, m_bounds[2 * c + 1].y) : m_bounds[2 * c + 1].y;
+							hasBounds = true;
+						}
+					}
+				}
+
+				if (doFitBounds) {
+					m_bounds[2 * n] = minimum;
+					m_bounds[2 * n + 1] = maximum;
+					node.center = (minimum + maximum) * 0.5f;
+					node.halfSize = std::max(maximum.x - minimum.x, maximum.y - minimum.y) * 0.5f;
+				}
+
+				if (node.mass > 0)
+					node.centerOfMass *= 1 / node.mass;
+				else
+					node.centerOfMass = node.center;
+
+				// Quadrupoles and reach need the center of mass, so they take a
+				// second pass. Children's moments move by the parallel axis
+				// theorem, and their reach by the distance between centers.
+				node.quadrupole = { 0, 0 };
+				node.inertia = 0;
+				node.reach = 0;
+
+				if (node.firstChild == -1) {
+					for (int b = node.firstBody; b < node.firstBody + node.bodyCount; b++) {
+						const Mass& mass = masses[m_bodies[b]];
+						if (!mass.doIgnore) {
+							Vector2 d = mass.position - node.centerOfMass;
+							node.quadrupole += Vector2{ d.x * d.x - d.y * d.y, 2 * d.x * d.y } * mass.mass;
+							node.inertia += (d.x * d.x + d.y * d.y) * mass.mass;
+							node.reach = std::max(node.reach, getLength(d));
+						}
+					}
+				}
+				else {
+					for (int quadrant = 0; quadrant < 4; quadrant++) {
+						const QuadTreeNode& child = m_nodes[node.firstChild + quadrant];
+						Vector2 d = child.centerOfMass - node.centerOfMass;
+						node.quadrupole += child.quadrupole + Vector2{ d.x * d.x - d.y * d.y, 2 * d.x * d.y } * child.mass;
+						node.inertia += child.inertia + (d.x * d.x + d.y * d.y) * child.mass;
+						if (child.mass > 0)
+							node.reach = std::max(node.reach, child.reach + getLength(d));
+					}
+				}
+			}
+		});
+	}
+}
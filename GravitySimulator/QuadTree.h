@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Mass.h"
+#include "MortonSorter.h"
+#include "ThreadPool.h"
+#include "Vector2.h"
+
+struct QuadTreeNode {
+	Vector2 center; // Geometric center of the cell
+	float halfSize;
+
+	Vector2 centerOfMass;
+	float mass; // Masses that are still waiting for a velocity do not count
+
+	// Traceless quadrupole about the center of mass, as the complex number
+	// sum of m (dx + i dy)^2: x is sum m (dx^2 - dy^2), y is sum 2 m dx dy
+	Vector2 quadrupole;
+	float inertia; // Sum of m (dx^2 + dy^2), the trace the quadrupole leaves out
+	float reach; // Distance from the center of mass to the farthest body
+
+	int firstChild; // Index of the first of four consecutive children, -1 for a leaf
+	int firstBody; // Range into QuadTree::bodies() covered by this cell
+	int bodyCount;
+};
+
+// Spatial index over a snapshot of masses. Every cell owns a contiguous range
+// of body indices, so a whole subtree can be visited or summarized at once.
+// Nodes are stored level by level, so children always follow their parent.
+//
+// The build sorts bodies by Morton key, after which every cell's bodies are
+// already contiguous and its children are found by binary search on the next
+// two key bits. Each level is split and then summarized in parallel, into
+// node storage kept between builds.
+class QuadTree {
+public:
+	void build(const std::vector<Mass>&, ThreadPool&);
+
+	// Keeps the tree's shape and body ranges but recomputes every cell's
+	// mass, center of mass and bounds from the current positions. Cells
+	// become the smallest squares around their bodies, so they stay correct,
+	// if looser, as bodies drift. The masses must be the ones last built from,
+	// in the same order.
+	void refit(const std::vector<Mass>&, ThreadPool&);
+
+	// Refits, except that it builds every rebuildInterval calls, after
+	// invalidate, or when the body count changes
+	void update(const std::vector<Mass>&, ThreadPool&, int rebuildInterval);
+	void invalidate();
+
+	const std::vector<QuadTreeNode>& nodes() const;
+	const std::vector<int>& bodies() const;
+
+private:
+	std::vector<QuadTreeNode> m_nodes;
+	std::vector<int> m_bodies;
+	std::vector<int> m_levelStart; // First node of each level, then the node count
+
+	MortonSorter m_sorter;
+	std::vector<int> m_childOffsets; // Per node of the level being split
+	std::vector<Vector2> m_bounds; // Minimum and maximum per node, while refitting
+
+	int m_updatesSinceBuild = 0;
+	bool m_isInvalid = true;
+
+	void splitLevel(int level, ThreadPool&);
+	void summarize(const std::vector<Mass>&, ThreadPool&, bool doFitBounds);
+};
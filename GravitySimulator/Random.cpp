@@ -0,0 +1,6 @@
+#include "Random.h"
+
+float getRandomUnit(std::mt19937& random)
+{
+	return static_cast<float>(random() >> 8) * (1.0f / 16777216.0f);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <random>
+
+// Uniform in [0, 1). Built from the raw engine output, whose sequence the
+// standard fixes, so generated scenes are identical on every platform.
+float getRandomUnit(std::mt19937&);
@@ -1,14 +1,26 @@
 
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
 #include <glad/glad.h>
 
 #include "Renderer.h"
 
-Renderer::Renderer(SDL_Window* window, SDL_GLContext glContext, ImGuiIO& io) : m_window(window), m_glContext(glContext), m_io(io), m_scale(1)
+Renderer::Renderer(SDL_Window* window, SDL_GLContext glContext, ImGuiIO& io) : m_window(window), m_glContext(glContext), m_io(io), m_scale(1),
+	m_targetFramebuffer(0), m_targetWidth(0), m_targetHeight(0), m_particleCapacity(0), m_densityWidth(), m_densityHeight(),
+	m_trailRequestedSampleCount(0), m_trailMaxBytes(0), m_trailSampleCount(0), m_trailBodyCapacity(0), m_trailBodyCount(0), m_trailHead(0), m_trailAppendCount(0)
 {
 	setupLineVAO();
 	setupLineShaderProgram();
 	setupCircleVAO();
 	setupCircleShaderProgram();
+	setupParticleVAO();
+	setupParticleShaderProgram();
+	setupDensityFBO();
+	setupDensityShaderPrograms();
+	setupTrailBuffers();
+	setupTrailShaderProgram();
 	updateScalingFactor();
 }
 
@@ -18,6 +30,18 @@ void Renderer::updateScalingFactor()
 
 	SDL_GetWindowSize(m_window, &width, &height);
 
+	// Pixel-sized quantities follow the render target, while the visible part
+	// of the world always follows the window
+	int targetWidth = width;
+	int targetHeight = height;
+	float pixelScale = m_scale;
+
+	if (m_targetFramebuffer != 0) {
+		targetWidth = m_targetWidth;
+		targetHeight = m_targetHeight;
+		pixelScale = m_scale * static_cast<float>(width) / static_cast<float>(targetWidth);
+	}
+
 	glUseProgram(m_lineShaderProgram);
 	scalingFactorLocation = glGetUniformLocation(m_lineShaderProgram, "scalingFactor");
 	glUniform2f(scalingFactorLocation, static_cast<float>(width) * m_scale, static_cast<float>(height) * m_scale);
@@ -26,7 +50,58 @@ void Renderer::updateScalingFactor()
 	scalingFactorLocation = glGetUniformLocation(m_circleShaderProgram, "scalingFactor");
 	glUniform2f(scalingFactorLocation, static_cast<float>(width) * m_scale, static_cast<float>(height) * m_scale);
 	int scaleLocation = glGetUniformLocation(m_circleShaderProgram, "scale");
-	glUniform1f(scaleLocation, m_scale);
+	glUniform1f(scaleLocation, pixelScale);
+
+	glUseProgram(m_particleShaderProgram);
+	scalingFactorLocation = glGetUniformLocation(m_particleShaderProgram, "scalingFactor");
+	glUniform2f(scalingFactorLocation, static_cast<float>(width) * m_scale, static_cast<float>(height) * m_scale);
+	scaleLocation = glGetUniformLocation(m_particleShaderProgram, "scale");
+	glUniform1f(scaleLocation, pixelScale);
+
+	glUseProgram(m_trailShaderProgram);
+	scalingFactorLocation = glGetUniformLocation(m_trailShaderProgram, "scalingFactor");
+	glUniform2f(scalingFactorLocation, static_cast<float>(width) * m_scale, static_cast<float>(height) * m_scale);
+
+	glUseProgram(m_densityShaderProgram);
+	scalingFactorLocation = glGetUniformLocation(m_densityShaderProgram, "scalingFactor");
+	glUniform2f(scalingFactorLocation, static_cast<float>(width) * m_scale, static_cast<float>(height) * m_scale);
+	scaleLocation = glGetUniformLocation(m_densityShaderProgram, "scale");
+	glUniform1f(scaleLocation, pixelScale);
+
+	// Keep the current target's density buffer the same size as the viewport
+	int buffer = densityBuffer();
+	if (targetWidth != m_densityWidth[buffer] || targetHeight != m_densityHeight[buffer]) {
+		m_densityWidth[buffer] = targetWidth;
+		m_densityHeight[buffer] = targetHeight;
+
+		glBindTexture(GL_TEXTURE_2D, m_densityTexture[buffer]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, targetWidth, targetHeight, 0, GL_RED, GL_FLOAT, nullptr);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+}
+
+void Renderer::setRenderTarget(unsigned framebuffer, int width, int height)
+{
+	m_targetFramebuffer = framebuffer;
+	m_targetWidth = width;
+	m_targetHeight = height;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+	updateScalingFactor();
+}
+
+void Renderer::resetRenderTarget()
+{
+	int width, height;
+
+	SDL_GetWindowSize(m_window, &width, &height);
+
+	m_targetFramebuffer = 0;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, width, height);
+	updateScalingFactor();
 }
 
 float Renderer::width()
@@ -74,6 +149,10 @@ void Renderer::setColor(float r, float g, float b)
 	glUseProgram(m_circleShaderProgram);
 	colorLocation = glGetUniformLocation(m_circleShaderProgram, "myColor");
 	glUniform3f(colorLocation, r, g, b);
+
+	glUseProgram(m_trailShaderProgram);
+	colorLocation = glGetUniformLocation(m_trailShaderProgram, "myColor");
+	glUniform3f(colorLocation, r, g, b);
 }
 
 void Renderer::drawLine(float x1, float y1, float x2, float y2)
@@ -102,13 +181,219 @@ void Renderer::drawCircle(float x, float y, float radius)
 	glDrawArrays(GL_TRIANGLES, 0, 6);
 }
 
+void Renderer::drawParticles(const ParticleVertex* particles, int count, float radius, float referenceMass)
+{
+	if (count <= 0)
+		return;
+
+	uploadParticles(particles, count);
+
+	glUseProgram(m_particleShaderProgram);
+
+	int radiusLocation = glGetUniformLocation(m_particleShaderProgram, "radius");
+	glUniform1f(radiusLocation, radius);
+	int referenceMassLocation = glGetUniformLocation(m_particleShaderProgram, "referenceMass");
+	glUniform1f(referenceMassLocation, referenceMass);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+
+	glDrawArrays(GL_POINTS, 0, count);
+
+	glDisable(GL_BLEND);
+}
+
+void Renderer::drawDensity(const ParticleVertex* particles, int count, float radius, float exposure)
+{
+	// Accumulate mass into the density buffer
+	glBindFramebuffer(GL_FRAMEBUFFER, m_densityFBO[densityBuffer()]);
+
+	float clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+	if (count > 0) {
+		uploadParticles(particles, count);
+
+		glUseProgram(m_densityShaderProgram);
+		int radiusLocation = glGetUniformLocation(m_densityShaderProgram, "radius");
+		glUniform1f(radiusLocation, radius);
+
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		glDrawArrays(GL_POINTS, 0, count);
+		glDisable(GL_BLEND);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_targetFramebuffer);
+
+	// Tone-map the density buffer onto the screen
+	glUseProgram(m_toneMapShaderProgram);
+	int exposureLocation = glGetUniformLocation(m_toneMapShaderProgram, "exposure");
+	glUniform1f(exposureLocation, exposure);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, m_densityTexture[densityBuffer()]);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glBindVertexArray(m_fullscreenVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glDisable(GL_BLEND);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Renderer::setTrailLength(int sampleCount, std::size_t maxBytes)
+{
+	if (sampleCount == m_trailRequestedSampleCount && maxBytes == m_trailMaxBytes)
+		return;
+
+	m_trailRequestedSampleCount = sampleCount;
+	m_trailMaxBytes = maxBytes;
+	resizeTrailBuffers(m_trailBodyCapacity);
+}
+
+void Renderer::appendTrailSample(const float* positions, int count)
+{
+	if (count < m_trailBodyCount) {
+		clearTrails();
+	}
+	if (count > m_trailBodyCapacity) {
+		resizeTrailBuffers(std::max(count, m_trailBodyCapacity + m_trailBodyCapacity / 2));
+	}
+	if (m_trailSampleCount == 0 || count == 0)
+		return;
+
+	m_trailHead = (m_trailHead + 1) % m_trailSampleCount;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, m_trailVBO);
+	glBufferSubData(GL_TEXTURE_BUFFER, static_cast<GLintptr>(m_trailHead) * m_trailBodyCapacity * 2 * sizeof(float), count * 2 * sizeof(float), positions);
+
+	// Bodies seen for the first time record when their history starts, so the
+	// shader never reads slots written before they existed
+	if (count > m_trailBodyCount) {
+		std::vector<int> births(count - m_trailBodyCount, m_trailAppendCount);
+		glBindBuffer(GL_TEXTURE_BUFFER, m_trailBirthVBO);
+		glBufferSubData(GL_TEXTURE_BUFFER, m_trailBodyCount * sizeof(int), births.size() * sizeof(int), births.data());
+		m_trailBodyCount = count;
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	m_trailAppendCount++;
+}
+
+void Renderer::clearTrails()
+{
+	m_trailBodyCount = 0;
+	m_trailHead = 0;
+	m_trailAppendCount = 0;
+}
+
+void Renderer::drawTrails()
+{
+	if (m_trailBodyCount == 0 || m_trailAppendCount < 2)
+		return;
+
+	glUseProgram(m_trailShaderProgram);
+
+	int bodyCapacityLocation = glGetUniformLocation(m_trailShaderProgram, "bodyCapacity");
+	glUniform1i(bodyCapacityLocation, m_trailBodyCapacity);
+	int sampleCountLocation = glGetUniformLocation(m_trailShaderProgram, "sampleCount");
+	glUniform1i(sampleCountLocation, m_trailSampleCount);
+	int headLocation = glGetUniformLocation(m_trailShaderProgram, "head");
+	glUniform1i(headLocation, m_trailHead);
+	int appendCountLocation = glGetUniformLocation(m_trailShaderProgram, "appendCount");
+	glUniform1i(appendCountLocation, m_trailAppendCount);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, m_trailTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_BUFFER, m_trailBirthTexture);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	// One line strip per body, all in a single instanced draw
+	glBindVertexArray(m_trailVAO);
+	glDrawArraysInstanced(GL_LINE_STRIP, 0, std::min(m_trailAppendCount, m_trailSampleCount), m_trailBodyCount);
+
+	glDisable(GL_BLEND);
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+int Renderer::trailSampleCount()
+{
+	return m_trailSampleCount;
+}
+
+std::size_t Renderer::trailMemoryUsage()
+{
+	return static_cast<std::size_t>(m_trailBodyCapacity) * m_trailSampleCount * 2 * sizeof(float) + m_trailBodyCapacity * sizeof(int);
+}
+
 void Renderer::unload()
 {
 	glDeleteBuffers(1, &m_lineVBO);
 	glDeleteVertexArrays(1, &m_lineVAO);
 	glDeleteVertexArrays(1, &m_circleVAO);
+	glDeleteBuffers(1, &m_particleVBO);
+	glDeleteVertexArrays(1, &m_particleVAO);
 	glDeleteProgram(m_lineShaderProgram);
 	glDeleteProgram(m_circleShaderProgram);
+	glDeleteVertexArrays(1, &m_fullscreenVAO);
+	glDeleteVertexArrays(1, &m_trailVAO);
+	glDeleteBuffers(1, &m_trailVBO);
+	glDeleteBuffers(1, &m_trailBirthVBO);
+	glDeleteTextures(1, &m_trailTexture);
+	glDeleteTextures(1, &m_trailBirthTexture);
+	glDeleteFramebuffers(2, m_densityFBO);
+	glDeleteTextures(2, m_densityTexture);
+	glDeleteProgram(m_particleShaderProgram);
+	glDeleteProgram(m_densityShaderProgram);
+	glDeleteProgram(m_toneMapShaderProgram);
+	glDeleteProgram(m_trailShaderProgram);
+}
+
+void Renderer::uploadParticles(const ParticleVertex* particles, int count)
+{
+	glBindVertexArray(m_particleVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, m_particleVBO);
+
+	// Orphan the old storage so the driver never waits on the previous frame's draw
+	if (count > m_particleCapacity)
+		m_particleCapacity = std::max(count, m_particleCapacity * 2);
+	glBufferData(GL_ARRAY_BUFFER, m_particleCapacity * sizeof(ParticleVertex), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(ParticleVertex), particles);
+}
+
+void Renderer::resizeTrailBuffers(int bodyCapacity)
+{
+	m_trailBodyCapacity = bodyCapacity;
+	m_trailSampleCount = 0;
+
+	// Fit the ring into both the memory budget and the texture buffer limit
+	if (bodyCapacity > 0) {
+		std::size_t budgetSamples = m_trailMaxBytes / (static_cast<std::size_t>(bodyCapacity) * 2 * sizeof(float));
+		std::size_t texelSamples = static_cast<std::size_t>(m_maxTextureBufferSize) / bodyCapacity;
+		m_trailSampleCount = static_cast<int>(std::min({ static_cast<std::size_t>(m_trailRequestedSampleCount), budgetSamples, texelSamples }));
+		if (m_trailSampleCount < 2)
+			m_trailSampleCount = 0;
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, m_trailVBO);
+	glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(m_trailBodyCapacity) * m_trailSampleCount * 2 * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_trailBirthVBO);
+	glBufferData(GL_TEXTURE_BUFFER, m_trailBodyCapacity * sizeof(int), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	clearTrails();
 }
 
 unsigned Renderer::createShaderProgram(const char* vertexShaderSource, const char* fragmentShaderSource)
@@ -254,3 +539,249 @@ void Renderer::setupCircleShaderProgram()
 
 	m_circleShaderProgram = createShaderProgram(vertexShaderSource, fragmentShaderSource);
 }
+
+void Renderer::setupParticleVAO()
+{
+	glGenVertexArrays(1, &m_particleVAO);
+	glBindVertexArray(m_particleVAO);
+
+	glGenBuffers(1, &m_particleVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, m_particleVBO);
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(ParticleVertex), (void*)offsetof(ParticleVertex, x));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(ParticleVertex), (void*)offsetof(ParticleVertex, mass));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ParticleVertex), (void*)offsetof(ParticleVertex, r));
+	glEnableVertexAttribArray(2);
+
+	glBindVertexArray(0);
+
+	// Sprite size is written by the vertex shader; software rasterizers such as
+	// llvmpipe cap it lower than most GPUs, so clamp against the reported range
+	float pointSizeRange[2];
+	glGetFloatv(GL_POINT_SIZE_RANGE, pointSizeRange);
+	m_maxPointSize = pointSizeRange[1];
+	glEnable(GL_PROGRAM_POINT_SIZE);
+}
+
+void Renderer::setupParticleShaderProgram()
+{
+	const char* vertexShaderSource =
+		"#version 330 core\n"
+		"layout (location = 0) in vec2 position;"
+		"layout (location = 1) in float mass;"
+		"layout (location = 2) in vec3 color;"
+		"uniform vec2 scalingFactor;"
+		"uniform float scale;"
+		"uniform float radius;"
+		"uniform float referenceMass;"
+		"uniform float maxPointSize;"
+		"out vec3 particleColor;"
+		"out float pixelRadius;"
+		"out float pointSize;"
+		"void main()"
+		"{"
+		"    float attenuation = clamp(pow(max(mass, 0.0) / referenceMass, 1.0 / 3.0), 0.25, 8.0);"
+		"    pixelRadius = min(radius * attenuation / scale, 0.5 * maxPointSize - 1.0);"
+		"    pointSize = 2.0 * ceil(pixelRadius) + 2.0;"
+		"    gl_PointSize = pointSize;"
+		"    particleColor = color;"
+		"    gl_Position = vec4(position.x * 2.0 / scalingFactor.x - 1.0, position.y * 2.0 / scalingFactor.y - 1.0, 0.0, 1.0);"
+		"}";
+
+	const char* fragmentShaderSource =
+		"#version 330 core\n"
+		"in vec3 particleColor;"
+		"in float pixelRadius;"
+		"in float pointSize;"
+		"out vec4 FragColor;"
+		"void main()"
+		"{"
+		"    float distance = length(gl_PointCoord - vec2(0.5)) * pointSize;"
+		"    float coverage = clamp(pixelRadius - distance + 0.5, 0.0, 1.0);"
+		"    coverage *= min(1.0, 4.0 * pixelRadius * pixelRadius);" // Sub-pixel bodies fade by area
+		"    FragColor = vec4(particleColor * coverage, coverage);"
+		"}";
+
+	m_particleShaderProgram = createShaderProgram(vertexShaderSource, fragmentShaderSource);
+
+	glUseProgram(m_particleShaderProgram);
+	int maxPointSizeLocation = glGetUniformLocation(m_particleShaderProgram, "maxPointSize");
+	glUniform1f(maxPointSizeLocation, m_maxPointSize);
+}
+
+int Renderer::densityBuffer() const
+{
+	return m_targetFramebuffer != 0 ? 1 : 0;
+}
+
+// Both buffers start at the window's size; the render target's is resized
+// the first time a target is set
+void Renderer::setupDensityFBO()
+{
+	glGenTextures(2, m_densityTexture);
+	glGenFramebuffers(2, m_densityFBO);
+
+	for (int buffer = 0; buffer < 2; buffer++) {
+		glBindTexture(GL_TEXTURE_2D, m_densityTexture[buffer]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		SDL_GetWindowSize(m_window, &m_densityWidth[buffer], &m_densityHeight[buffer]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, m_densityWidth[buffer], m_densityHeight[buffer], 0, GL_RED, GL_FLOAT, nullptr);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, m_densityFBO[buffer]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_densityTexture[buffer], 0);
+	}
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Density framebuffer is incomplete", "Floating-point render targets are not supported.", m_window);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// The tone-mapping pass generates its triangle from gl_VertexID
+	glGenVertexArrays(1, &m_fullscreenVAO);
+}
+
+void Renderer::setupDensityShaderPrograms()
+{
+	const char* splatVertexShaderSource =
+		"#version 330 core\n"
+		"layout (location = 0) in vec2 position;"
+		"layout (location = 1) in float mass;"
+		"uniform vec2 scalingFactor;"
+		"uniform float scale;"
+		"uniform float radius;"
+		"uniform float maxPointSize;"
+		"out float splatMass;"
+		"out float pixelRadius;"
+		"void main()"
+		"{"
+		"    pixelRadius = clamp(radius / scale, 1.0, 0.5 * maxPointSize);"
+		"    gl_PointSize = 2.0 * pixelRadius;"
+		"    splatMass = mass;"
+		"    gl_Position = vec4(position.x * 2.0 / scalingFactor.x - 1.0, position.y * 2.0 / scalingFactor.y - 1.0, 0.0, 1.0);"
+		"}";
+
+	// Epanechnikov-style kernel normalized to integrate to the body's mass
+	const char* splatFragmentShaderSource =
+		"#version 330 core\n"
+		"in float splatMass;"
+		"in float pixelRadius;"
+		"out vec4 FragColor;"
+		"void main()"
+		"{"
+		"    vec2 offset = gl_PointCoord * 2.0 - vec2(1.0);"
+		"    float q = 1.0 - dot(offset, offset);"
+		"    if (q <= 0.0) {"
+		"        discard;"
+		"    }"
+		"    FragColor = vec4(splatMass * q * 2.0 / (3.14159265 * pixelRadius * pixelRadius), 0.0, 0.0, 0.0);"
+		"}";
+
+	const char* toneMapVertexShaderSource =
+		"#version 330 core\n"
+		"out vec2 textureCoordinate;"
+		"void main()"
+		"{"
+		"    vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));"
+		"    textureCoordinate = corner;"
+		"    gl_Position = vec4(corner * 2.0 - vec2(1.0), 0.0, 1.0);"
+		"}";
+
+	const char* toneMapFragmentShaderSource =
+		"#version 330 core\n"
+		"uniform sampler2D density;"
+		"uniform float exposure;"
+		"in vec2 textureCoordinate;"
+		"out vec4 FragColor;"
+		"const float WHITE_POINT = 1000.0;"
+		"void main()"
+		"{"
+		"    float value = texture(density, textureCoordinate).r;"
+		"    float t = clamp(asinh(value * exposure) / asinh(WHITE_POINT), 0.0, 1.0);"
+		"    vec3 color = mix(vec3(0.2, 0.0, 0.4), vec3(1.0, 0.3, 0.0), smoothstep(0.0, 0.6, t));"
+		"    color = mix(color, vec3(1.0, 1.0, 0.8), smoothstep(0.5, 1.0, t));"
+		"    FragColor = vec4(color * t, 1.0);"
+		"}";
+
+	m_densityShaderProgram = createShaderProgram(splatVertexShaderSource, splatFragmentShaderSource);
+	m_toneMapShaderProgram = createShaderProgram(toneMapVertexShaderSource, toneMapFragmentShaderSource);
+
+	glUseProgram(m_densityShaderProgram);
+	int maxPointSizeLocation = glGetUniformLocation(m_densityShaderProgram, "maxPointSize");
+	glUniform1f(maxPointSizeLocation, m_maxPointSize);
+
+	glUseProgram(m_toneMapShaderProgram);
+	int densityLocation = glGetUniformLocation(m_toneMapShaderProgram, "density");
+	glUniform1i(densityLocation, 0);
+}
+
+void Renderer::setupTrailBuffers()
+{
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &m_maxTextureBufferSize);
+
+	glGenBuffers(1, &m_trailVBO);
+	glGenTextures(1, &m_trailTexture);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_trailVBO);
+	glBindTexture(GL_TEXTURE_BUFFER, m_trailTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, m_trailVBO);
+
+	glGenBuffers(1, &m_trailBirthVBO);
+	glGenTextures(1, &m_trailBirthTexture);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_trailBirthVBO);
+	glBindTexture(GL_TEXTURE_BUFFER, m_trailBirthTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, m_trailBirthVBO);
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	// Trail vertices are fetched from the texture buffers by gl_VertexID and gl_InstanceID
+	glGenVertexArrays(1, &m_trailVAO);
+}
+
+void Renderer::setupTrailShaderProgram()
+{
+	const char* vertexShaderSource =
+		"#version 330 core\n"
+		"uniform samplerBuffer trailPositions;"
+		"uniform isamplerBuffer trailBirths;"
+		"uniform vec2 scalingFactor;"
+		"uniform int bodyCapacity;"
+		"uniform int sampleCount;"
+		"uniform int head;"
+		"uniform int appendCount;"
+		"out float fade;"
+		"void main()"
+		"{"
+		"    int body = gl_InstanceID;"
+		"    int age = min(gl_VertexID, appendCount - texelFetch(trailBirths, body).r - 1);"
+		"    int slot = (head - age + sampleCount) % sampleCount;"
+		"    vec2 position = texelFetch(trailPositions, slot * bodyCapacity + body).xy;"
+		"    fade = 1.0 - float(gl_VertexID) / float(sampleCount);"
+		"    gl_Position = vec4(position.x * 2.0 / scalingFactor.x - 1.0, position.y * 2.0 / scalingFactor.y - 1.0, 0.0, 1.0);"
+		"}";
+
+	const char* fragmentShaderSource =
+		"#version 330 core\n"
+		"uniform vec3 myColor;"
+		"in float fade;"
+		"out vec4 FragColor;"
+		"void main()"
+		"{"
+		"    FragColor = vec4(myColor, fade * fade);"
+		"}";
+
+	m_trailShaderProgram = createShaderProgram(vertexShaderSource, fragmentShaderSource);
+
+	glUseProgram(m_trailShaderProgram);
+	int trailPositionsLocation = glGetUniformLocation(m_trailShaderProgram, "trailPositions");
+	glUniform1i(trailPositionsLocation, 0);
+	int trailBirthsLocation = glGetUniformLocation(m_trailShaderProgram, "trailBirths");
+	glUniform1i(trailBirthsLocation, 1);
+}
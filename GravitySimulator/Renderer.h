@@ -1,15 +1,29 @@
 
 #pragma once
 
+#include <cstddef>
+
 #include <SDL.h>
 #include "imgui/imgui.h"
 
+// Per-body vertex layout for the particle renderer
+struct ParticleVertex {
+	float x, y;
+	float mass;
+	float r, g, b;
+};
+
 class Renderer {
 public:
 	explicit Renderer(SDL_Window*, SDL_GLContext, ImGuiIO&);
 
 	void updateScalingFactor();
 
+	// Redirects drawing into an offscreen framebuffer. The same part of the
+	// world stays visible, rendered at the framebuffer's resolution.
+	void setRenderTarget(unsigned framebuffer, int width, int height);
+	void resetRenderTarget();
+
 	float width();
 	float height();
 
@@ -22,6 +36,27 @@ public:
 	void drawLine(float x1, float y1, float x2, float y2);
 	void drawCircle(float x, float y, float radius);
 
+	// Draws every particle in one call as additive, anti-aliased point sprites.
+	// Sprite radius is `radius` for a body of `referenceMass` and grows with the
+	// cube root of mass.
+	void drawParticles(const ParticleVertex*, int count, float radius, float referenceMass);
+
+	// Accumulates the mass of every particle into a floating-point density
+	// buffer, then tone-maps it to the screen with an asinh curve. The cost of
+	// the final pass depends on the window size, not on the number of bodies.
+	void drawDensity(const ParticleVertex*, int count, float radius, float exposure);
+
+	// Orbit trails live in one GPU ring buffer holding `sampleCount` positions
+	// per body. The ring is sized down if it would exceed `maxBytes` and is
+	// cleared whenever its dimensions change.
+	void setTrailLength(int sampleCount, std::size_t maxBytes);
+	void appendTrailSample(const float* positions, int count); // Interleaved x, y
+	void clearTrails();
+	void drawTrails();
+
+	int trailSampleCount();
+	std::size_t trailMemoryUsage();
+
 	void unload();
 
 private:
@@ -30,13 +65,49 @@ private:
 	ImGuiIO& m_io;
 	float m_scale;
 
+	unsigned m_targetFramebuffer;
+	int m_targetWidth;
+	int m_targetHeight;
+
 	unsigned m_lineVAO;
 	unsigned m_lineVBO;
 
 	unsigned m_circleVAO;
 
+	unsigned m_particleVAO;
+	unsigned m_particleVBO;
+	int m_particleCapacity;
+	float m_maxPointSize;
+
+	// [0] follows the window and [1] the offscreen render target, so
+	// switching between them every captured frame does not reallocate
+	unsigned m_densityFBO[2];
+	unsigned m_densityTexture[2];
+	int m_densityWidth[2];
+	int m_densityHeight[2];
+
+	unsigned m_fullscreenVAO;
+
+	unsigned m_trailVAO;
+	unsigned m_trailVBO;
+	unsigned m_trailTexture;
+	unsigned m_trailBirthVBO;
+	unsigned m_trailBirthTexture;
+	int m_trailRequestedSampleCount;
+	std::size_t m_trailMaxBytes;
+	int m_trailSampleCount;
+	int m_trailBodyCapacity;
+	int m_trailBodyCount;
+	int m_trailHead;
+	int m_trailAppendCount;
+	int m_maxTextureBufferSize;
+
 	unsigned m_lineShaderProgram;
 	unsigned m_circleShaderProgram;
+	unsigned m_particleShaderProgram;
+	unsigned m_densityShaderProgram;
+	unsigned m_toneMapShaderProgram;
+	unsigned m_trailShaderProgram;
 
 	unsigned createShaderProgram(const char* vertexShaderSource, const char* fragmentShaderSource);
 
@@ -44,4 +115,14 @@ private:
 	void setupLineShaderProgram();
 	void setupCircleVAO();
 	void setupCircleShaderProgram();
+	void setupParticleVAO();
+	void setupParticleShaderProgram();
+	void setupDensityFBO();
+	int densityBuffer() const; // Index of the current target's density buffer
+	void setupDensityShaderPrograms();
+	void setupTrailBuffers();
+	void setupTrailShaderProgram();
+	void resizeTrailBuffers(int bodyCapacity);
+
+	void uploadParticles(const ParticleVertex*, int count);
 };
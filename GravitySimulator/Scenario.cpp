@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <SDL.h>
+
+#include "imgui/imgui.h"
+#include "imgui/imgui_internal.h"
+
+#include "Scenario.h"
+
+// Local state and functions
+namespace {
+
+	// Widget being searched for by click-item, filled in by the test engine hooks
+	const char* targetWindow = nullptr;
+	const char* targetLabel = nullptr;
+	bool isTargetFound = false;
+	ImRect targetRect;
+
+	ImGuiID lastItemId = 0;
+	ImRect lastItemRect;
+
+	// Reads a word or a double-quoted string. Returns false at the end of the line.
+	bool readToken(const char*& cursor, std::string& token)
+	{
+		while (*cursor == ' ' || *cursor == '\t') {
+			cursor++;
+		}
+
+		if (*cursor == '\0' || *cursor == '\n' || *cursor == '\r' || *cursor == '#')
+			return false;
+
+		token.clear();
+
+		if (*cursor == '"') {
+			cursor++;
+			while (*cursor != '\0' && *cursor != '"' && *cursor != '\n') {
+				token.push_back(*cursor++);
+			}
+			if (*cursor == '"')
+				cursor++;
+		}
+		else {
+			while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\n' && *cursor != '\r') {
+				token.push_back(*cursor++);
+			}
+		}
+
+		return true;
+	}
+
+};
+
+#ifdef IMGUI_ENABLE_TEST_ENGINE
+
+void ImGuiTestEngineHook_ItemAdd(ImGuiContext*, const ImRect& bb, ImGuiID id)
+{
+	lastItemId = id;
+	lastItemRect = bb;
+}
+
+void ImGuiTestEngineHook_ItemInfo(ImGuiContext* context, ImGuiID id, const char* label, ImGuiItemStatusFlags)
+{
+	if (targetLabel == nullptr || id != lastItemId || std::strcmp(label, targetLabel) != 0)
+		return;
+
+	// Items inside child windows and tables belong to "Parent/Child" windows
+	const char* windowName = context->CurrentWindow->Name;
+	if (std::strncmp(windowName, targetWindow, std::strlen(targetWindow)) == 0) {
+		targetRect = lastItemRect;
+		isTargetFound = true;
+	}
+}
+
+void ImGuiTestEngineHook_IdInfo(ImGuiContext*, ImGuiDataType, ImGuiID, const void*) {}
+void ImGuiTestEngineHook_IdInfo(ImGuiContext*, ImGuiDataType, ImGuiID, const void*, const void*) {}
+void ImGuiTestEngineHook_Log(ImGuiContext*, const char*, ...) {}
+
+#endif
+
+ScenarioPlayer::ScenarioPlayer() : m_threshold(0), m_commandIndex(0), m_commandFrame(0), m_hasFailed(false)
+{
+}
+
+ScenarioPlayer::~ScenarioPlayer()
+{
+	targetWindow = nullptr;
+	targetLabel = nullptr;
+}
+
+bool ScenarioPlayer::load(const std::string& path)
+{
+	std::FILE* file = std::fopen(path.c_str(), "r");
+	if (file == nullptr) {
+		SDL_Log("Failed to open scenario %s", path.c_str());
+		return false;
+	}
+
+	m_path = path;
+	m_commands.clear();
+
+	float totalSeconds = 0;
+	char line[512];
+	int lineNumber = 0;
+	bool isValid = true;
+
+	while (isValid && std::fgets(line, sizeof(line), file) != nullptr) {
+		lineNumber++;
+
+		const char* cursor = line;
+		std::string name;
+		if (!readToken(cursor, name))
+			continue;
+
+		std::string arguments[2];
+		int argumentCount = 0;
+		while (argumentCount < 2 && readToken(cursor, arguments[argumentCount])) {
+			argumentCount++;
+		}
+
+		Command command = {};
+
+		if (name == "threshold" && argumentCount == 1) {
+			m_threshold = std::strtof(arguments[0].c_str(), nullptr);
+			continue;
+		}
+		else if ((name == "click" || name == "double-click") && argumentCount == 2) {
+			command.type = name == "click" ? CommandType::Click : CommandType::DoubleClick;
+			command.x = std::strtof(arguments[0].c_str(), nullptr);
+			command.y = std::strtof(arguments[1].c_str(), nullptr);
+		}
+		else if (name == "click-item" && argumentCount == 2) {
+			command.type = CommandType::ClickItem;
+			command.window = arguments[0];
+			command.label = arguments[1];
+		}
+		else if (name == "type" && argumentCount == 1) {
+			command.type = CommandType::Type;
+			command.label = arguments[0];
+		}
+		else if (name == "wait" && argumentCount == 1) {
+			command.type = CommandType::Wait;
+			command.frames = std::atoi(arguments[0].c_str());
+		}
+		else if (name == "run" && argumentCount == 1) {
+			command.type = CommandType::Run;
+			command.seconds = std::strtof(arguments[0].c_str(), nullptr);
+			totalSeconds += command.seconds;
+		}
+		else if (name == "check-forces" && argumentCount == 2) {
+			command.type = CommandType::CheckForces;
+			command.label = arguments[0];
+			command.tolerance = std::strtof(arguments[1].c_str(), nullptr);
+		}
+		else {
+			SDL_Log("Scenario %s, line %d: unknown command or wrong arguments", path.c_str(), lineNumber);
+			isValid = false;
+		}
+
+		m_commands.push_back(command);
+	}
+
+	std::fclose(file);
+
+	// Room for a thousand frames per second, so measuring never allocates
+	m_frameTimes.clear();
+	m_frameTimes.reserve(static_cast<std::size_t>(totalSeconds * 1000) + 1);
+
+	m_commandIndex = 0;
+	m_commandFrame = 0;
+	m_commandStart = std::chrono::steady_clock::now();
+	m_lastFrameEnd = m_commandStart;
+
+	return isValid;
+}
+
+void ScenarioPlayer::sendProgramInput(Program& program, Renderer& renderer)
+{
+	if (isFinished() || m_commandFrame != 0)
+		return;
+
+	const Command& command = m_commands[m_commandIndex];
+	if (command.type == CommandType::CheckForces) {
+		float error = program.measureForceError(command.label);
+		if (error < 0) {
+			SDL_Log("Scenario %s: cannot check the forces of \"%s\"", m_path.c_str(), command.label.c_str());
+			m_hasFailed = true;
+		}
+		else if (error > command.tolerance) {
+			SDL_Log("Scenario %s: %s has RMS relative error %.2e, over %.2e", m_path.c_str(), command.label.c_str(), error, command.tolerance);
+			m_hasFailed = true;
+		}
+		return;
+	}
+
+	if (command.type != CommandType::Click && command.type != CommandType::DoubleClick)
+		return;
+
+	SDL_MouseButtonEvent e = {};
+	e.type = SDL_MOUSEBUTTONDOWN;
+	e.button = SDL_BUTTON_LEFT;
+	e.state = SDL_PRESSED;
+	e.x = static_cast<Sint32>(command.x);
+	e.y = static_cast<Sint32>(command.y);
+
+	// SDL reports a double click as a single click followed by one with two clicks
+	e.clicks = 1;
+	program.mousePressed(renderer, e);
+
+	if (command.type == CommandType::DoubleClick) {
+		e.clicks = 2;
+		program.mousePressed(renderer, e);
+	}
+}
+
+void ScenarioPlayer::sendImGuiInput()
+{
+	if (isFinished())
+		return;
+
+	ImGui::GetCurrentContext()->TestEngineHookItems = true;
+
+	const Command& command = m_commands[m_commandIndex];
+	ImGuiIO& io = ImGui::GetIO();
+
+	if (command.type == CommandType::ClickItem) {
+		// Frame 0 brings the window to the front and looks for the item, then
+		// the mouse hovers, presses and releases over it
+		if (m_commandFrame == 0) {
+			ImGui::SetWindowFocus(command.window.c_str());
+			targetWindow = command.window.c_str();
+			targetLabel = command.label.c_str();
+			isTargetFound = false;
+		}
+		else {
+			io.MousePos = targetRect.GetCenter();
+			io.MouseDown[0] = m_commandFrame == 2;
+		}
+	}
+	else if (command.type == CommandType::Type) {
+		if (m_commandFrame == 0) {
+			io.AddInputCharactersUTF8(command.label.c_str());
+		}
+		else {
+			io.KeysDown[io.KeyMap[ImGuiKey_Enter]] = m_commandFrame == 1;
+		}
+	}
+}
+
+void ScenarioPlayer::endFrame()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	float frameTime = std::chrono::duration<float, std::milli>(now - m_lastFrameEnd).count();
+	m_lastFrameEnd = now;
+
+	if (isFinished())
+		return;
+
+	const Command& command = m_commands[m_commandIndex];
+	m_commandFrame++;
+
+	switch (command.type) {
+	case CommandType::Click:
+	case CommandType::DoubleClick:
+	case CommandType::CheckForces:
+		finishCommand();
+		break;
+	case CommandType::ClickItem:
+		if (m_commandFrame == 1) {
+			targetLabel = nullptr;
+			if (!isTargetFound) {
+				SDL_Log("Scenario %s: no item \"%s\" in window \"%s\"", m_path.c_str(), command.label.c_str(), command.window.c_str());
+				m_hasFailed = true;
+				finishCommand();
+			}
+		}
+		else if (m_commandFrame == 4) {
+			finishCommand();
+		}
+		break;
+	case CommandType::Type:
+		if (m_commandFrame == 3)
+			finishCommand();
+		break;
+	case CommandType::Wait:
+		if (m_commandFrame >= command.frames)
+			finishCommand();
+		break;
+	case CommandType::Run:
+		m_frameTimes.push_back(frameTime);
+		if (std::chrono::duration<float>(now - m_commandStart).count() >= command.seconds)
+			finishCommand();
+		break;
+	}
+}
+
+bool ScenarioPlayer::isFinished() const
+{
+	return m_commandIndex >= static_cast<int>(m_commands.size());
+}
+
+bool ScenarioPlayer::isRunning() const
+{
+	return !isFinished() && m_commands[m_commandIndex].type == CommandType::Run;
+}
+
+bool ScenarioPlayer::report() const
+{
+	if (m_frameTimes.empty()) {
+		std::printf("Scenario %s: no frames were measured\n", m_path.c_str());
+		return !m_hasFailed;
+	}
+
+	std::vector<float> sorted = m_frameTimes;
+	std::sort(sorted.begin(), sorted.end());
+
+	auto getPercentile = [&](float percentile) {
+		std::size_t index = static_cast<std::size_t>(percentile / 100 * sorted.size());
+		return sorted[std::min(index, sorted.size() - 1)];
+	};
+
+	float p99 = getPercentile(99);
+
+	std::printf("Scenario %s: %d frames, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n", m_path.c_str(),
+		static_cast<int>(sorted.size()), getPercentile(50), getPercentile(90), p99, sorted.back());
+
+	if (m_threshold > 0 && p99 > m_threshold) {
+		std::printf("Scenario %s FAILED: p99 frame time %.2f ms exceeds the %.2f ms threshold\n", m_path.c_str(), p99, m_threshold);
+		return false;
+	}
+
+	return !m_hasFailed;
+}
+
+void ScenarioPlayer::finishCommand()
+{
+	m_commandIndex++;
+	m_commandFrame = 0;
+	m_commandStart = m_lastFrameEnd;
+}
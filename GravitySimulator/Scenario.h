@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Program.h"
+
+// Plays a scripted session against the real program, as an end-to-end
+// performance and correctness test. Scenario files hold one command per line:
+//
+//   threshold <ms>                 fail if the p99 frame time exceeds this
+//   click <x> <y>                  Program::mousePressed at window pixels
+//   double-click <x> <y>
+//   click-item "<window>" "<label>" click an ImGui widget
+//   type "<text>"                  replace the focused widget's text, then Enter
+//   wait <frames>                  frames that are not measured, e.g. warm-up
+//   run <seconds>                  frames whose times are measured
+//   check-forces "<engine>" <rms>  fail if the engine's RMS relative error
+//                                  against direct summation exceeds this
+//
+// Widgets are found through Dear ImGui's test engine hooks, so the build
+// defines IMGUI_ENABLE_TEST_ENGINE; the hooks stay off unless a scenario runs.
+class ScenarioPlayer {
+public:
+	explicit ScenarioPlayer();
+	~ScenarioPlayer();
+
+	ScenarioPlayer(const ScenarioPlayer&) = delete;
+	ScenarioPlayer& operator=(const ScenarioPlayer&) = delete;
+
+	// Returns false if the file could not be read or parsed
+	bool load(const std::string& path);
+
+	// Call after polling events
+	void sendProgramInput(Program&, Renderer&);
+	// Call between the platform backend's NewFrame and ImGui::NewFrame
+	void sendImGuiInput();
+	void endFrame();
+
+	bool isFinished() const;
+	// True on frames of a run command, which send no input
+	bool isRunning() const;
+
+	// Prints the frame time percentiles. Returns false if the scenario failed.
+	bool report() const;
+
+private:
+	enum class CommandType {
+		Click,
+		DoubleClick,
+		ClickItem,
+		Type,
+		Wait,
+		Run,
+		CheckForces,
+	};
+
+	struct Command {
+		CommandType type;
+		float x, y;
+		std::string window;
+		std::string label; // Or the text to type, or the engine to check
+		int frames;
+		float seconds;
+		float tolerance;
+	};
+
+	std::string m_path;
+	std::vector<Command> m_commands;
+	float m_threshold; // [ms] Zero never fails on time
+
+	int m_commandIndex;
+	int m_commandFrame; // Frames spent on the current command
+	std::chrono::steady_clock::time_point m_commandStart;
+	std::chrono::steady_clock::time_point m_lastFrameEnd;
+
+	std::vector<float> m_frameTimes; // [ms] Measured during run commands
+	bool m_hasFailed;
+
+	void finishCommand();
+};
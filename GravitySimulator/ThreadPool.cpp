@@ -0,0 +1,102 @@
+#include <algorithm>
+
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+ThreadPool::ThreadPool(int threadCount)
+	: m_task(nullptr), m_context(nullptr), m_count(0), m_grainSize(1), m_chunkCount(0), m_nextChunk(0), m_generation(0), m_busyWorkers(0), m_isStopping(false)
+{
+	for (int i = 1; i < threadCount; i++) {
+		m_workers.emplace_back(&ThreadPool::runWorker, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStopping = true;
+	}
+	m_workReady.notify_all();
+
+	for (std::thread& worker : m_workers) {
+		worker.join();
+	}
+}
+
+int ThreadPool::threadCount() const
+{
+	return static_cast<int>(m_workers.size()) + 1;
+}
+
+void ThreadPool::run(int count, int grainSize, Task task, const void* context)
+{
+	grainSize = std::max(grainSize, 1);
+
+	if (m_workers.empty() || count <= grainSize) {
+		if (count > 0)
+			task(context, 0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = task;
+		m_context = context;
+		m_count = count;
+		m_grainSize = grainSize;
+		m_chunkCount = (count + grainSize - 1) / grainSize;
+		m_nextChunk.store(0, std::memory_order_relaxed);
+		m_busyWorkers = static_cast<int>(m_workers.size());
+		m_generation++;
+	}
+	m_workReady.notify_all();
+
+	runChunks();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_workDone.wait(lock, [this] { return m_busyWorkers == 0; });
+}
+
+void ThreadPool::runWorker()
+{
+	setTraceThreadName("Worker");
+
+	unsigned generation = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_workReady.wait(lock, [&] { return m_generation != generation || m_isStopping; });
+
+			if (m_isStopping)
+				return;
+
+			generation = m_generation;
+		}
+
+		{
+			PROFILE_SCOPE("Worker chunks");
+			runChunks();
+		}
+
+		bool isLast;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			isLast = --m_busyWorkers == 0;
+		}
+		if (isLast)
+			m_workDone.notify_one();
+	}
+}
+
+void ThreadPool::runChunks()
+{
+	int chunk;
+	while ((chunk = m_nextChunk.fetch_add(1, std::memory_order_relaxed)) < m_chunkCount) {
+		int begin = chunk * m_grainSize;
+		int end = std::min(begin + m_grainSize, m_count);
+		m_task(m_context, begin, end);
+	}
+}
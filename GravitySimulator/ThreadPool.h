@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops. The calling thread
+// works alongside the workers, so a pool of one thread runs everything inline.
+class ThreadPool {
+public:
+	explicit ThreadPool(int threadCount);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int threadCount() const;
+
+	// Calls function(begin, end) over [0, count) in chunks of grainSize and
+	// returns once every chunk has run. Each index is handled by exactly one
+	// call, so as long as chunks write disjoint data the results do not depend
+	// on the thread count or on which thread ran which chunk.
+	template <typename Function>
+	void parallelFor(int count, int grainSize, const Function& function)
+	{
+		run(count, grainSize, [](const void* context, int begin, int end) {
+			(*static_cast<const Function*>(context))(begin, end);
+		}, &function);
+	}
+
+private:
+	typedef void (*Task)(const void* context, int begin, int end);
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_workReady;
+	std::condition_variable m_workDone;
+
+	Task m_task;
+	const void* m_context;
+	int m_count;
+	int m_grainSize;
+	int m_chunkCount;
+	std::atomic<int> m_nextChunk;
+
+	unsigned m_generation; // Incremented for every dispatched loop
+	int m_busyWorkers;
+	bool m_isStopping;
+
+	void run(int count, int grainSize, Task, const void* context);
+	void runWorker();
+	void runChunks();
+};
@@ -0,0 +1,176 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "Trace.h"
+
+// Global Constants
+namespace {
+
+	const int CHUNK_SIZE = 4096; // Events
+	const int MAX_CHUNKS_PER_THREAD = 1024; // Recording stops after about 100 MiB per thread
+
+};
+
+// Local state
+namespace {
+
+	struct TraceEvent {
+		const char* name;
+		std::int64_t start; // Nanoseconds since the trace epoch
+		std::int64_t duration;
+	};
+
+	// Written by exactly one thread; `count` and `next` publish its progress
+	// to readers
+	struct TraceChunk {
+		TraceEvent events[CHUNK_SIZE];
+		std::atomic<int> count;
+		std::atomic<TraceChunk*> next;
+	};
+
+	struct ThreadTrace {
+		int id;
+		std::atomic<const char*> name;
+		TraceChunk* first;
+		TraceChunk* last;
+		int chunkCount;
+	};
+
+	std::atomic<bool> tracingEnabled(false);
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	std::mutex threadsMutex;
+	std::vector<ThreadTrace*> threads; // Never shrinks, so pointers stay valid for dumps
+
+	TraceChunk* createChunk()
+	{
+		TraceChunk* chunk = new TraceChunk;
+		chunk->count.store(0, std::memory_order_relaxed);
+		chunk->next.store(nullptr, std::memory_order_relaxed);
+		return chunk;
+	}
+
+	ThreadTrace& getThreadTrace()
+	{
+		thread_local ThreadTrace* threadTrace = nullptr;
+
+		if (threadTrace == nullptr) {
+			std::lock_guard<std::mutex> lock(threadsMutex);
+
+			threadTrace = new ThreadTrace;
+			threadTrace->id = static_cast<int>(threads.size());
+			threadTrace->name.store(nullptr, std::memory_order_relaxed);
+			threadTrace->first = createChunk();
+			threadTrace->last = threadTrace->first;
+			threadTrace->chunkCount = 1;
+
+			threads.push_back(threadTrace);
+		}
+
+		return *threadTrace;
+	}
+
+	void writeEscaped(std::FILE* file, const char* text)
+	{
+		for (; *text != '\0'; text++) {
+			if (*text == '"' || *text == '\\')
+				std::fputc('\\', file);
+			std::fputc(*text, file);
+		}
+	}
+
+};
+
+void setTracingEnabled(bool isEnabled)
+{
+	tracingEnabled.store(isEnabled, std::memory_order_relaxed);
+}
+
+bool isTracingEnabled()
+{
+	return tracingEnabled.load(std::memory_order_relaxed);
+}
+
+void setTraceThreadName(const char* name)
+{
+	getThreadTrace().name.store(name, std::memory_order_release);
+}
+
+void recordTraceEvent(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	if (!isTracingEnabled())
+		return;
+
+	ThreadTrace& thread = getThreadTrace();
+	TraceChunk* chunk = thread.last;
+	int count = chunk->count.load(std::memory_order_relaxed);
+
+	if (count == CHUNK_SIZE) {
+		if (thread.chunkCount == MAX_CHUNKS_PER_THREAD)
+			return;
+
+		TraceChunk* next = createChunk();
+		chunk->next.store(next, std::memory_order_release);
+		thread.last = next;
+		thread.chunkCount++;
+
+		chunk = next;
+		count = 0;
+	}
+
+	TraceEvent& event = chunk->events[count];
+	event.name = name;
+	event.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch).count();
+	event.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+	chunk->count.store(count + 1, std::memory_order_release);
+}
+
+bool writeTrace(const char* path)
+{
+	std::FILE* file = std::fopen(path, "w");
+	if (file == nullptr)
+		return false;
+
+	std::vector<ThreadTrace*> snapshot;
+	{
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		snapshot = threads;
+	}
+
+	std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	bool isFirst = true;
+
+	for (ThreadTrace* thread : snapshot) {
+		const char* name = thread->name.load(std::memory_order_acquire);
+		if (name != nullptr) {
+			std::fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", isFirst ? "" : ",\n", thread->id);
+			writeEscaped(file, name);
+			std::fprintf(file, "\"}}");
+			isFirst = false;
+		}
+
+		for (TraceChunk* chunk = thread->first; chunk != nullptr; chunk = chunk->next.load(std::memory_order_acquire)) {
+			int count = chunk->count.load(std::memory_order_acquire);
+
+			for (int i = 0; i < count; i++) {
+				const TraceEvent& event = chunk->events[i];
+				std::fprintf(file, "%s{\"ph\":\"X\",\"name\":\"", isFirst ? "" : ",\n");
+				writeEscaped(file, event.name);
+				std::fprintf(file, "\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", thread->id, event.start / 1000.0, event.duration / 1000.0);
+				isFirst = false;
+			}
+		}
+	}
+
+	std::fprintf(file, "\n]}\n");
+
+	bool isWritten = std::ferror(file) == 0;
+	std::fclose(file);
+
+	return isWritten;
+}
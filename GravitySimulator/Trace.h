@@ -0,0 +1,18 @@
+#pragma once
+
+#include <chrono>
+
+// Timeline recorder for the Chrome trace event format, which Perfetto and
+// chrome://tracing can open. Every thread appends complete events to its own
+// chunked buffer without locking; a dump may run while threads keep recording.
+
+void setTracingEnabled(bool);
+bool isTracingEnabled();
+
+// Names the calling thread in the exported timeline
+void setTraceThreadName(const char* name);
+
+void recordTraceEvent(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+// Writes every event recorded so far. Returns false if the file could not be written.
+bool writeTrace(const char* path);
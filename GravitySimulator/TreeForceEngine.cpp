@@ -0,0 +1,587 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "FrameArena.h"
+#include "Profiler.h"
+#include "TreeForceEngine.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define GRAVITY_USE_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GRAVITY_USE_SSE
+#endif
+
+// Global Constants
+namespace {
+
+	const int GROUP_SIZE = 64; // Most bodies in a group
+	const int GROUP_GRAIN_SIZE = 4; // Groups per parallel task
+	const float DRIFT_TOLERANCE = 0.25f; // Of a group cell's half size
+	const float MAX_RELISTED_FRACTION = 0.25f; // Of the groups; past it a full build is cheaper
+
+#if defined(GRAVITY_USE_AVX)
+	const int LANE_COUNT = 8;
+#elif defined(GRAVITY_USE_SSE)
+	const int LANE_COUNT = 4;
+#else
+	const int LANE_COUNT = 1;
+#endif
+
+};
+
+// Local functions
+namespace {
+
+// Quadrupole part of a cell's pull at r from the target to its center of
+// mass: G conj(Q) r^3 / |r|^6 in complex form
+Vector2 getQuadrupolePull(Vector2 quadrupole, Vector2 r)
+{
+	float x2 = r.x * r.x;
+	float y2 = r.y * r.y;
+	float inverse = 1 / (x2 + y2);
+	float scale = GRAVITATIONAL_CONSTANT * inverse * inverse * inverse;
+
+	Vector2 cube = { r.x * (x2 - 3 * y2), r.y * (3 * x2 - y2) };
+	return Vector2{ quadrupole.x * cube.x + quadrupole.y * cube.y, quadrupole.x * cube.y - quadrupole.y * cube.x } * scale;
+}
+
+// One group's interaction list as structures of arrays in the frame arena,
+// padded to a whole number of lanes with sources of zero strength
+struct ListBuffers {
+	float* cellX;
+	float* cellY;
+	float* cellStrength; // G times mass
+	float* cellQuadrupoleX; // G times the quadrupole
+	float* cellQuadrupoleY;
+	float* bodyX;
+	float* bodyY;
+	float* bodyStrength; // Zero for ignored bodies
+};
+
+int padToLanes(int count)
+{
+	return (count + LANE_COUNT - 1) / LANE_COUNT * LANE_COUNT;
+}
+
+float* allocateLanes(FrameArena& arena, int paddedCount)
+{
+	float* values = arena.allocateArray<float>(paddedCount);
+	std::fill(values + std::max(paddedCount - LANE_COUNT, 0), values + paddedCount, 0.0f);
+	return values;
+}
+
+#if defined(GRAVITY_USE_AVX) || defined(GRAVITY_USE_SSE)
+
+#if defined(GRAVITY_USE_AVX)
+typedef __m256 Lanes;
+
+Lanes loadLanes(const float* values) { return _mm256_loadu_ps(values); }
+Lanes broadcast(float value) { return _mm256_set1_ps(value); }
+Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+Lanes subtract(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+Lanes multiply(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+
+// 1 / x where x > 0, else 0, which masks a body's own term
+Lanes reciprocalOrZero(Lanes x)
+{
+	return _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1), x), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ));
+}
+
+float sumLanes(Lanes lanes)
+{
+	float values[8];
+	_mm256_storeu_ps(values, lanes);
+	return ((values[0] + values[1]) + (values[2] + values[3])) + ((values[4] + values[5]) + (values[6] + values[7]));
+}
+#else
+typedef __m128 Lanes;
+
+Lanes loadLanes(const float* values) { return _mm_loadu_ps(values); }
+Lanes broadcast(float value) { return _mm_set1_ps(value); }
+Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+Lanes subtract(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+Lanes multiply(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+
+// 1 / x where x > 0, else 0, which masks a body's own term
+Lanes reciprocalOrZero(Lanes x)
+{
+	return _mm_and_ps(_mm_div_ps(_mm_set1_ps(1), x), _mm_cmpgt_ps(x, _mm_setzero_ps()));
+}
+
+float sumLanes(Lanes lanes)
+{
+	float values[4];
+	_mm_storeu_ps(values, lanes);
+	return (values[0] + values[1]) + (values[2] + values[3]);
+}
+#endif
+
+// Every source of the list on one target, LANE_COUNT sources at a time
+Vector2 evaluateList(const ListBuffers& list, int cellCount, int bodyCount, Vector2 position)
+{
+	Lanes targetX = broadcast(position.x);
+	Lanes targetY = broadcast(position.y);
+	Lanes three = broadcast(3);
+	Lanes sumX = broadcast(0);
+	Lanes sumY = broadcast(0);
+
+	for (int j = 0; j < cellCount; j += LANE_COUNT) {
+		Lanes dx = subtract(loadLanes(&list.cellX[j]), targetX);
+		Lanes dy = subtract(loadLanes(&list.cellY[j]), targetY);
+		Lanes x2 = multiply(dx, dx);
+		Lanes y2 = multiply(dy, dy);
+		Lanes inverse = reciprocalOrZero(add(x2, y2));
+
+		Lanes monopole = multiply(loadLanes(&list.cellStrength[j]), inverse);
+		sumX = add(sumX, multiply(dx, monopole));
+		sumY = add(sumY, multiply(dy, monopole));
+
+		Lanes cubeX = multiply(dx, subtract(x2, multiply(three, y2)));
+		Lanes cubeY = multiply(dy, subtract(multiply(three, x2), y2));
+		Lanes quadrupoleX = loadLanes(&list.cellQuadrupoleX[j]);
+		Lanes quadrupoleY = loadLanes(&list.cellQuadrupoleY[j]);
+		Lanes inverseCubed = multiply(inverse, multiply(inverse, inverse));
+		sumX = add(sumX, multiply(add(multiply(quadrupoleX, cubeX), multiply(quadrupoleY, cubeY)), inverseCubed));
+		sumY = add(sumY, multiply(subtract(multiply(quadrupoleX, cubeY), multiply(quadrupoleY, cubeX)), inverseCubed));
+	}
+
+	for (int j = 0; j < bodyCount; j += LANE_COUNT) {
+		Lanes dx = subtract(loadLanes(&list.bodyX[j]), targetX);
+		Lanes dy = subtract(loadLanes(&list.bodyY[j]), targetY);
+		Lanes scale = multiply(loadLanes(&list.bodyStrength[j]), reciprocalOrZero(add(multiply(dx, dx), multiply(dy, dy))));
+		sumX = add(sumX, multiply(dx, scale));
+		sumY = add(sumY, multiply(dy, scale));
+	}
+
+	return { sumLanes(sumX), sumLanes(sumY) };
+}
+
+#endif
+
+};
+
+TreeForceEngine::TreeForceEngine(float openingAngle) : m_rebuildInterval(1), m_openingTest(openingAngle), m_hasLists(false), m_listAge(0), m_staleEntryCount(0)
+{
+}
+
+const char* TreeForceEngine::name() const
+{
+	return "Barnes-Hut tree";
+}
+
+bool TreeForceEngine::supportsPeriodic() const
+{
+	return true;
+}
+
+void TreeForceEngine::resetCaches()
+{
+	m_hasLists = false;
+}
+
+int TreeForceEngine::rebuildInterval() const
+{
+	return m_rebuildInterval;
+}
+
+void TreeForceEngine::setRebuildInterval(int rebuildInterval)
+{
+	m_rebuildInterval = std::max(rebuildInterval, 1);
+}
+
+const OpeningTest& TreeForceEngine::openingTest() const
+{
+	return m_openingTest;
+}
+
+void TreeForceEngine::setOpeningTest(const OpeningTest& openingTest)
+{
+	m_openingTest = openingTest;
+	m_hasLists = false;
+}
+
+void TreeForceEngine::computeAccelerations(std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	if (masses.empty()) {
+		m_hasLists = false;
+		return;
+	}
+
+	// Drift is measured against the body ranges, which refitting keeps
+	int driftedCount = canReuseLists(masses) ? markDriftedGroups(masses, threadPool) : -1;
+
+	if (driftedCount >= 0 && driftedCount <= MAX_RELISTED_FRACTION * m_groups.size()) {
+		{
+			PROFILE_SCOPE("Refit tree");
+			m_tree.refit(masses, threadPool);
+		}
+
+		{
+			PROFILE_SCOPE("Interaction lists");
+			markFailedCells(threadPool);
+			rebuildDriftedLists(masses);
+		}
+
+		m_listAge++;
+	}
+	else {
+		{
+			PROFILE_SCOPE("Build tree");
+			m_tree.build(masses, threadPool);
+		}
+
+		{
+			PROFILE_SCOPE("Interaction lists");
+			buildLists(masses);
+		}
+
+		m_listAge = 1;
+	}
+
+	{
+		PROFILE_SCOPE("Evaluate lists");
+		evaluate(masses, threadPool);
+	}
+}
+
+bool TreeForceEngine::canReuseLists(const std::vector<Mass>& masses) const
+{
+	return m_hasLists && m_listAge < m_rebuildInterval && masses.size() == m_listPositions.size();
+}
+
+// Flags the groups with a body that has moved too far since their list was
+// made, and returns how many there are
+int TreeForceEngine::markDriftedGroups(const std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+	const std::vector<int>& bodies = m_tree.bodies();
+	const PeriodicDomain& domain = m_domain;
+
+	m_hasGroupDrifted.assign(m_groups.size(), 0);
+
+	threadPool.parallelFor(static_cast<int>(m_groups.size()), GROUP_GRAIN_SIZE, [&](int begin, int end) {
+		for (int g = begin; g < end; g++) {
+			const QuadTreeNode& node = nodes[m_groups[g].node];
+			float limit = m_groups[g].driftLimit;
+
+			for (int b = node.firstBody; b < node.firstBody + node.bodyCount; b++) {
+				int i = bodies[b];
+				Vector2 drift = getNearestImage(domain, masses[i].position - m_listPositions[i]);
+				if (std::fabs(drift.x) > limit || std::fabs(drift.y) > limit) {
+					m_hasGroupDrifted[g] = 1;
+					break;
+				}
+			}
+		}
+	});
+
+	return static_cast<int>(std::count(m_hasGroupDrifted.begin(), m_hasGroupDrifted.end(), 1));
+}
+
+// Flags the groups with an accepted cell that no longer passes the opening
+// test against the group's box, now that the tree is refit. Leaves are
+// summed body by body, so they stay exact.
+void TreeForceEngine::markFailedCells(ThreadPool& threadPool)
+{
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+
+	threadPool.parallelFor(static_cast<int>(m_groups.size()), GROUP_GRAIN_SIZE, [&](int begin, int end) {
+		for (int g = begin; g < end; g++) {
+			const Group& group = m_groups[g];
+			if (m_hasGroupDrifted[g])
+				continue;
+
+			for (int c = group.firstCell; c < group.firstCell + group.cellCount; c++) {
+				if (!acceptsCell(nodes[m_cells[c]], group)) {
+					m_hasGroupDrifted[g] = 1;
+					break;
+				}
+			}
+		}
+	});
+}
+
+// Groups are the largest cells with at most GROUP_SIZE bodies. The walks are
+// serial so the lists, and so the order of every sum, are fixed; they are
+// also much rarer than evaluations once lists are reused.
+void TreeForceEngine::buildLists(const std::vector<Mass>& masses)
+{
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+
+	m_groups.clear();
+	m_cells.clear();
+	m_leaves.clear();
+
+	m_stack.clear();
+	m_stack.push_back(0);
+	while (!m_stack.empty()) {
+		int n = m_stack.back();
+		m_stack.pop_back();
+
+		const QuadTreeNode& node = nodes[n];
+		if (node.bodyCount == 0)
+			continue;
+
+		if (node.bodyCount <= GROUP_SIZE || node.firstChild == -1) {
+			Group group = {};
+			group.node = n;
+			m_groups.push_back(group);
+			continue;
+		}
+
+		for (int quadrant = 3; quadrant >= 0; quadrant--) {
+			m_stack.push_back(node.firstChild + quadrant);
+		}
+	}
+
+	for (Group& group : m_groups) {
+		buildGroupList(group, masses);
+	}
+
+	m_listPositions.resize(masses.size());
+	for (int i = 0; i < masses.size(); i++) {
+		m_listPositions[i] = masses[i].position;
+	}
+
+	m_hasLists = true;
+	m_staleEntryCount = 0;
+}
+
+// Appends new lists for the drifted groups, leaving the old ones in place
+// until replaced lists outnumber live ones, when every list is rebuilt
+// against the refit tree to compact them
+void TreeForceEngine::rebuildDriftedLists(const std::vector<Mass>& masses)
+{
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+	const std::vector<int>& bodies = m_tree.bodies();
+
+	for (int g = 0; g < static_cast<int>(m_groups.size()); g++) {
+		if (!m_hasGroupDrifted[g])
+			continue;
+
+		Group& group = m_groups[g];
+		m_staleEntryCount += group.cellCount + group.leafCount;
+		buildGroupList(group, masses);
+
+		const QuadTreeNode& node = nodes[group.node];
+		for (int b = node.firstBody; b < node.firstBody + node.bodyCount; b++) {
+			m_listPositions[bodies[b]] = masses[bodies[b]].position;
+		}
+	}
+
+	if (2 * m_staleEntryCount > static_cast<int>(m_cells.size() + m_leaves.size())) {
+		buildLists(masses);
+	}
+}
+
+// Walks the tree for one group from its bodies' current bounding box, and
+// appends the accepted cells and the leaves it reaches
+void TreeForceEngine::buildGroupList(Group& group, const std::vector<Mass>& masses)
+{
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+	const std::vector<int>& bodies = m_tree.bodies();
+
+	const QuadTreeNode& groupNode = nodes[group.node];
+	group.driftLimit = DRIFT_TOLERANCE * groupNode.halfSize;
+	group.minimum = masses[bodies[groupNode.firstBody]].position;
+	group.maximum = group.minimum;
+	for (int b = groupNode.firstBody; b < groupNode.firstBody + groupNode.bodyCount; b++) {
+		const Vector2& position = masses[bodies[b]].position;
+		group.minimum.x = std::min(group.minimum.x, position.x);
+		group.minimum.y = std::min(group.minimum.y, position.y);
+		group.maximum.x = std::max(group.maximum.x, position.x);
+		group.maximum.y = std::max(group.maximum.y, position.y);
+	}
+
+	// The relative error criterion holds the weakest pull in the group,
+	// from the last step, to its tolerance
+	group.acceleration = std::numeric_limits<float>::max();
+	for (int b = groupNode.firstBody; b < groupNode.firstBody + groupNode.bodyCount; b++) {
+		group.acceleration = std::min(group.acceleration, getLength(masses[bodies[b]].acceleration));
+	}
+
+	group.firstCell = static_cast<int>(m_cells.size());
+	group.firstLeaf = static_cast<int>(m_leaves.size());
+
+	m_stack.clear();
+	m_stack.push_back(0);
+	while (!m_stack.empty()) {
+		const int n = m_stack.back();
+		m_stack.pop_back();
+
+		// Cells whose only bodies are ignored stay in the lists, since a
+		// refit gives them mass once a waiting mass is released
+		const QuadTreeNode& node = nodes[n];
+		if (node.bodyCount == 0)
+			continue;
+
+		if (acceptsCell(node, group)) {
+			m_cells.push_back(n);
+		}
+		else if (node.firstChild == -1) {
+			m_leaves.push_back(n);
+		}
+		else {
+			for (int quadrant = 3; quadrant >= 0; quadrant--) {
+				m_stack.push_back(node.firstChild + quadrant);
+			}
+		}
+	}
+
+	group.cellCount = static_cast<int>(m_cells.size()) - group.firstCell;
+	group.leafCount = static_cast<int>(m_leaves.size()) - group.firstLeaf;
+}
+
+// A cell overlapping the group's box may hold some of its bodies. Refit
+// cells are fitted to their bodies, so one on the edge of the box can round
+// to separate; cells sharing the group's bodies are never accepted.
+bool TreeForceEngine::acceptsCell(const QuadTreeNode& node, const Group& group) const
+{
+	const QuadTreeNode& groupNode = m_tree.nodes()[group.node];
+	if (node.firstBody < groupNode.firstBody + groupNode.bodyCount && groupNode.firstBody < node.firstBody + node.bodyCount)
+		return false;
+
+	Vector2 groupCenter = (group.minimum + group.maximum) * 0.5f;
+	Vector2 groupHalfSize = (group.maximum - group.minimum) * 0.5f;
+
+	Vector2 offset = getNearestImage(m_domain, node.center - groupCenter);
+	bool isSeparate = std::fabs(offset.x) > node.halfSize + groupHalfSize.x || std::fabs(offset.y) > node.halfSize + groupHalfSize.y;
+
+	Vector2 r = getNearestImage(m_domain, node.centerOfMass - groupCenter);
+	float gapX = std::max(0.0f, std::fabs(r.x) - groupHalfSize.x);
+	float gapY = std::max(0.0f, std::fabs(r.y) - groupHalfSize.y);
+
+	return isSeparate && m_openingTest.accepts(node, gapX * gapX + gapY * gapY, group.acceleration);
+}
+
+void TreeForceEngine::evaluate(std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+#if defined(GRAVITY_USE_AVX) || defined(GRAVITY_USE_SSE)
+	// Ewald corrections need a table lookup per pair, which stays scalar
+	if (!m_domain.isEnabled) {
+		evaluateVectorized(masses, threadPool);
+		return;
+	}
+#endif
+
+	evaluateScalar(masses, threadPool);
+}
+
+// Gathers each group's list into structure-of-arrays buffers once, then
+// runs every body of the group through it with the vector kernel
+void TreeForceEngine::evaluateVectorized(std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+#if defined(GRAVITY_USE_AVX) || defined(GRAVITY_USE_SSE)
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+	const std::vector<int>& bodies = m_tree.bodies();
+
+	threadPool.parallelFor(static_cast<int>(m_groups.size()), GROUP_GRAIN_SIZE, [&](int begin, int end) {
+		FrameArena& arena = getFrameArena();
+
+		for (int g = begin; g < end; g++) {
+			const Group& group = m_groups[g];
+			FrameArena::Marker marker = arena.mark();
+
+			int sourceCount = 0;
+			for (int l = group.firstLeaf; l < group.firstLeaf + group.leafCount; l++) {
+				sourceCount += nodes[m_leaves[l]].bodyCount;
+			}
+
+			int cellCount = padToLanes(group.cellCount);
+			int bodyCount = padToLanes(sourceCount);
+
+			ListBuffers list;
+			list.cellX = allocateLanes(arena, cellCount);
+			list.cellY = allocateLanes(arena, cellCount);
+			list.cellStrength = allocateLanes(arena, cellCount);
+			list.cellQuadrupoleX = allocateLanes(arena, cellCount);
+			list.cellQuadrupoleY = allocateLanes(arena, cellCount);
+			list.bodyX = allocateLanes(arena, bodyCount);
+			list.bodyY = allocateLanes(arena, bodyCount);
+			list.bodyStrength = allocateLanes(arena, bodyCount);
+
+			for (int c = 0; c < group.cellCount; c++) {
+				const QuadTreeNode& node = nodes[m_cells[group.firstCell + c]];
+				list.cellX[c] = node.centerOfMass.x;
+				list.cellY[c] = node.centerOfMass.y;
+				list.cellStrength[c] = GRAVITATIONAL_CONSTANT * node.mass;
+				list.cellQuadrupoleX[c] = GRAVITATIONAL_CONSTANT * node.quadrupole.x;
+				list.cellQuadrupoleY[c] = GRAVITATIONAL_CONSTANT * node.quadrupole.y;
+			}
+
+			int source = 0;
+			for (int l = group.firstLeaf; l < group.firstLeaf + group.leafCount; l++) {
+				const QuadTreeNode& leaf = nodes[m_leaves[l]];
+
+				for (int s = leaf.firstBody; s < leaf.firstBody + leaf.bodyCount; s++, source++) {
+					const Mass& mass = masses[bodies[s]];
+					list.bodyX[source] = mass.position.x;
+					list.bodyY[source] = mass.position.y;
+					list.bodyStrength[source] = mass.doIgnore ? 0.0f : GRAVITATIONAL_CONSTANT * mass.mass;
+				}
+			}
+
+			const QuadTreeNode& groupNode = nodes[group.node];
+			for (int b = groupNode.firstBody; b < groupNode.firstBody + groupNode.bodyCount; b++) {
+				Mass& mass = masses[bodies[b]];
+				mass.acceleration = evaluateList(list, cellCount, bodyCount, mass.position);
+			}
+
+			arena.rewind(marker);
+		}
+	});
+#endif
+}
+
+void TreeForceEngine::evaluateScalar(std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+	const std::vector<int>& bodies = m_tree.bodies();
+	const PeriodicDomain& domain = m_domain;
+
+	threadPool.parallelFor(static_cast<int>(m_groups.size()), GROUP_GRAIN_SIZE, [&](int begin, int end) {
+		for (int g = begin; g < end; g++) {
+			const Group& group = m_groups[g];
+			const QuadTreeNode& groupNode = nodes[group.node];
+
+			for (int b = groupNode.firstBody; b < groupNode.firstBody + groupNode.bodyCount; b++) {
+				int i = bodies[b];
+				Vector2 position = masses[i].position;
+				Vector2 sum = { 0, 0 };
+
+				for (int c = group.firstCell; c < group.firstCell + group.cellCount; c++) {
+					const QuadTreeNode& node = nodes[m_cells[c]];
+					Vector2 r = getNearestImage(domain, node.centerOfMass - position);
+
+					if (domain.isEnabled)
+						sum += getPeriodicPull(domain, r, GRAVITATIONAL_CONSTANT * node.mass);
+					else
+						sum += r * (GRAVITATIONAL_CONSTANT * node.mass / (r.x * r.x + r.y * r.y));
+
+					sum += getQuadrupolePull(node.quadrupole, r);
+				}
+
+				for (int l = group.firstLeaf; l < group.firstLeaf + group.leafCount; l++) {
+					const QuadTreeNode& leaf = nodes[m_leaves[l]];
+
+					for (int s = leaf.firstBody; s < leaf.firstBody + leaf.bodyCount; s++) {
+						const Mass& source = masses[bodies[s]];
+						if (bodies[s] == i || source.doIgnore)
+							continue;
+
+						Vector2 d = source.position - position;
+						if (domain.isEnabled)
+							sum += getPeriodicPull(domain, getNearestImage(domain, d), GRAVITATIONAL_CONSTANT * source.mass);
+						else
+							sum += d * (GRAVITATIONAL_CONSTANT * source.mass / (d.x * d.x + d.y * d.y));
+					}
+				}
+
+				masses[i].acceleration = sum;
+			}
+		}
+	});
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+
+#include "ForceEngine.h"
+#include "OpeningCriterion.h"
+#include "QuadTree.h"
+
+// Barnes-Hut: distant cells of a quadtree are replaced by their total mass and
+// quadrupole about their center of mass. The tree is walked once per group
+// of nearby bodies, one small cell's worth, and cells are accepted by the
+// opening test against their distance from the group's bounding box. Each
+// walk leaves an interaction list: the accepted cells, and the leaves whose
+// bodies are summed one by one.
+//
+// Between full builds the tree is only refit and the lists are reused, so a
+// step costs just the kernel evaluations. A group gets a new list, walked
+// against the refit tree, when its bodies drift more than a fraction of its
+// cell from where they were when the list was made, or when refitting has
+// moved or grown one of its accepted cells until the cell fails the opening
+// test. Other groups keep their lists. Everything is rebuilt after
+// rebuildInterval steps, or when too many groups need new lists.
+//
+// Each list is gathered into flat arrays once per group and then run against
+// all of the group's bodies with AVX, which the x64 configurations enable,
+// or SSE elsewhere.
+class TreeForceEngine : public ForceEngine {
+public:
+	explicit TreeForceEngine(float openingAngle = 0.7f);
+
+	const char* name() const final;
+	bool supportsPeriodic() const final;
+
+	void resetCaches() final;
+	void computeAccelerations(std::vector<Mass>&, ThreadPool&) final;
+
+	// Steps between full tree builds. The tree is refit and the interaction
+	// lists reused in between, which is cheaper but loosens the cells.
+	int rebuildInterval() const;
+	void setRebuildInterval(int);
+
+	const OpeningTest& openingTest() const;
+	void setOpeningTest(const OpeningTest&);
+
+private:
+	struct Group {
+		int node;
+		Vector2 minimum; // Bounding box of the group's bodies when its list was made
+		Vector2 maximum;
+		float driftLimit; // Largest move along an axis before the list is stale
+		float acceleration; // Weakest pull on the group's bodies, for the relative error criterion
+		int firstCell; // Range into m_cells
+		int cellCount;
+		int firstLeaf; // Range into m_leaves
+		int leafCount;
+	};
+
+	QuadTree m_tree;
+	int m_rebuildInterval;
+	OpeningTest m_openingTest;
+
+	std::vector<Group> m_groups;
+	std::vector<int> m_cells; // Accepted nodes, per group
+	std::vector<int> m_leaves; // Leaf nodes summed body by body, per group
+	std::vector<int> m_stack;
+
+	bool m_hasLists;
+	int m_listAge; // Steps since the tree was built
+	std::vector<Vector2> m_listPositions; // By mass index, when its group's list was made
+	std::vector<char> m_hasGroupDrifted; // Or the group's list is otherwise stale
+	int m_staleEntryCount; // Entries of replaced lists still in m_cells and m_leaves
+
+	bool canReuseLists(const std::vector<Mass>&) const;
+	int markDriftedGroups(const std::vector<Mass>&, ThreadPool&);
+	void markFailedCells(ThreadPool&);
+	void buildLists(const std::vector<Mass>&);
+	void rebuildDriftedLists(const std::vector<Mass>&);
+	void buildGroupList(Group&, const std::vector<Mass>&);
+	bool acceptsCell(const QuadTreeNode&, const Group&) const;
+	void evaluate(std::vector<Mass>&, ThreadPool&);
+	void evaluateVectorized(std::vector<Mass>&, ThreadPool&);
+	void evaluateScalar(std::vector<Mass>&, ThreadPool&);
+};
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Profiler.h"
+#include "TreePmForceEngine.h"
+
+// Global Constants
+namespace {
+
+	const int GRAIN_SIZE = 64; // Bodies per parallel task
+	const int MAX_STACK_SIZE = 3 * 32 + 4; // Three pending siblings per level of the deepest tree, plus the root's children
+
+};
+
+// Local functions
+namespace {
+
+// Second-order part of a cell's short-range pull at r from the target to its
+// center of mass. With F(r) = G r h(|r|^2) and h = exp(c |r|^2) / |r|^2, the
+// expansion over the cell's bodies leaves 2 M r h' + tr(M) r h' +
+// 2 r (r.M.r) h'' for the second moment M = (quadrupole, inertia)
+Vector2 getShortRangeQuadrupolePull(const QuadTreeNode& node, Vector2 r, float h, float splitScale)
+{
+	float distanceSquared = r.x * r.x + r.y * r.y;
+	float inverse = 1 / distanceSquared;
+	float slope = splitScale - inverse;
+	float firstDerivative = h * slope;
+	float secondDerivative = h * (slope * slope + inverse * inverse);
+
+	Vector2 quadrupole = node.quadrupole;
+	Vector2 rotated = { quadrupole.x * r.x + quadrupole.y * r.y, quadrupole.y * r.x - quadrupole.x * r.y };
+	float projected = node.inertia * distanceSquared + quadrupole.x * (r.x * r.x - r.y * r.y) + 2 * quadrupole.y * r.x * r.y;
+
+	return ((r * (2 * node.inertia) + rotated) * firstDerivative + r * (projected * secondDerivative)) * GRAVITATIONAL_CONSTANT;
+}
+
+};
+
+TreePmForceEngine::TreePmForceEngine(int meshSize, float splitRadius, float cutoff, float openingAngle) :
+	m_mesh(meshSize, MeshBoundary::Isolated), m_rebuildInterval(1), m_cutoff(cutoff), m_openingTest(openingAngle)
+{
+	m_mesh.setSplitRadius(splitRadius);
+}
+
+const char* TreePmForceEngine::name() const
+{
+	return "TreePM";
+}
+
+// A periodic mesh sums every image of the long-range part, and the
+// short-range part is too short to reach past the nearest image
+bool TreePmForceEngine::supportsPeriodic() const
+{
+	return true;
+}
+
+void TreePmForceEngine::setDomain(const PeriodicDomain& domain)
+{
+	ForceEngine::setDomain(domain);
+	m_mesh.setDomain(domain);
+}
+
+void TreePmForceEngine::resetCaches()
+{
+	m_tree.invalidate();
+}
+
+int TreePmForceEngine::rebuildInterval() const
+{
+	return m_rebuildInterval;
+}
+
+void TreePmForceEngine::setRebuildInterval(int rebuildInterval)
+{
+	m_rebuildInterval = std::max(rebuildInterval, 1);
+}
+
+PmForceEngine& TreePmForceEngine::mesh()
+{
+	return m_mesh;
+}
+
+const OpeningTest& TreePmForceEngine::openingTest() const
+{
+	return m_openingTest;
+}
+
+void TreePmForceEngine::setOpeningTest(const OpeningTest& openingTest)
+{
+	m_openingTest = openingTest;
+}
+
+float TreePmForceEngine::splitRadius() const
+{
+	return m_mesh.splitRadius();
+}
+
+void TreePmForceEngine::setSplitRadius(float cells)
+{
+	m_mesh.setSplitRadius(cells);
+}
+
+void TreePmForceEngine::computeAccelerations(std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	if (masses.empty())
+		return;
+
+	{
+		PROFILE_SCOPE("Long range");
+		m_mesh.computeAccelerations(masses, threadPool);
+	}
+
+	{
+		PROFILE_SCOPE("Build tree");
+		m_tree.update(masses, threadPool, m_rebuildInterval);
+	}
+
+	{
+		PROFILE_SCOPE("Short range");
+		addShortRange(masses, threadPool);
+	}
+}
+
+void TreePmForceEngine::addShortRange(std::vector<Mass>& masses, ThreadPool& threadPool)
+{
+	const std::vector<QuadTreeNode>& nodes = m_tree.nodes();
+	const std::vector<int>& bodies = m_tree.bodies();
+	const PeriodicDomain& domain = m_domain;
+
+	float splitRadius = m_mesh.splitRadius() * m_mesh.spacing();
+	float cutoffSquared = (m_cutoff * splitRadius) * (m_cutoff * splitRadius);
+	float splitScale = -1 / (4 * splitRadius * splitRadius);
+
+	threadPool.parallelFor(static_cast<int>(masses.size()), GRAIN_SIZE, [&](int begin, int end) {
+		int stack[MAX_STACK_SIZE];
+
+		for (int i = begin; i < end; i++) {
+			Vector2 position = masses[i].position;
+			Vector2 sum = { 0, 0 };
+			float acceleration = getLength(masses[i].acceleration);
+
+			int stackSize = 0;
+			stack[stackSize++] = 0;
+
+			while (stackSize > 0) {
+				const QuadTreeNode& node = nodes[stack[--stackSize]];
+
+				if (node.mass == 0)
+					continue;
+
+				// Skip cells whose nearest point is beyond the cutoff
+				Vector2 offset = getNearestImage(domain, position - node.center);
+				float gapX = std::max(0.0f, std::fabs(offset.x) - node.halfSize);
+				float gapY = std::max(0.0f, std::fabs(offset.y) - node.halfSize);
+				if (gapX * gapX + gapY * gapY > cutoffSquared)
+					continue;
+
+				Vector2 r = getNearestImage(domain, node.centerOfMass - position);
+				float distanceSquared = r.x * r.x + r.y * r.y;
+
+				// A cell that contains the body is always opened
+				bool isOutside = gapX > 0 || gapY > 0;
+
+				if (isOutside && m_openingTest.accepts(node, distanceSquared, acceleration)) {
+					float h = std::exp(distanceSquared * splitScale) / distanceSquared;
+					sum += r * (GRAVITATIONAL_CONSTANT * node.mass * h) + getShortRangeQuadrupolePull(node, r, h, splitScale);
+				}
+				else if (node.firstChild == -1) {
+					for (int b = node.firstBody; b < node.firstBody + node.bodyCount; b++) {
+						const Mass& source = masses[bodies[b]];
+						if (bodies[b] != i && !source.doIgnore) {
+							Vector2 d = getNearestImage(domain, source.position - position);
+							float dSquared = d.x * d.x + d.y * d.y;
+							sum += d * (GRAVITATIONAL_CONSTANT * source.mass * std::exp(dSquared * splitScale) / dSquared);
+						}
+					}
+				}
+				else {
+					for (int quadrant = 0; quadrant < 4; quadrant++) {
+						stack[stackSize++] = node.firstChild + quadrant;
+					}
+				}
+			}
+
+			masses[i].acceleration += sum;
+		}
+	});
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ForceEngine.h"
+#include "OpeningCriterion.h"
+#include "PmForceEngine.h"
+#include "QuadTree.h"
+
+// Splits the 1/r force at a radius r_s of a few mesh cells. The long-range
+// part, G m (1 - exp(-r^2 / 4 r_s^2)) / r, is what the particle mesh gives
+// with a Gaussian-filtered Green's function. The short-range remainder,
+// G m exp(-r^2 / 4 r_s^2) / r, is summed with a Barnes-Hut walk that skips
+// every cell beyond the cutoff. This keeps the tree's resolution in dense
+// clusters without walking the whole tree for distant ones. Accepted cells
+// add their quadrupole through the second derivatives of the split kernel,
+// which unlike 1/r needs the cell's trace as well.
+class TreePmForceEngine : public ForceEngine {
+public:
+	explicit TreePmForceEngine(int meshSize = 256, float splitRadius = 1.25f, float cutoff = 4.5f, float openingAngle = 0.7f);
+
+	const char* name() const final;
+	bool supportsPeriodic() const final;
+	void setDomain(const PeriodicDomain&) final;
+
+	void resetCaches() final;
+	void computeAccelerations(std::vector<Mass>&, ThreadPool&) final;
+
+	// Steps between full tree builds. The tree is refit in between, which
+	// is cheaper but loosens its cells as bodies move.
+	int rebuildInterval() const;
+	void setRebuildInterval(int);
+
+	PmForceEngine& mesh();
+
+	float splitRadius() const; // In mesh cells
+	void setSplitRadius(float cells);
+
+	// The relative error criterion compares against the mesh's part of each
+	// body's acceleration, from the same step
+	const OpeningTest& openingTest() const;
+	void setOpeningTest(const OpeningTest&);
+
+private:
+	PmForceEngine m_mesh;
+	QuadTree m_tree;
+	int m_rebuildInterval;
+	float m_cutoff; // In split radii
+	OpeningTest m_openingTest;
+
+	void addShortRange(std::vector<Mass>&, ThreadPool&);
+};
@@ -1,4 +1,7 @@
 
+#include <algorithm>
+#include <memory>
+
 #include <glad/glad.h>
 #include <SDL.h>
 
@@ -7,7 +10,20 @@
 #include "imgui/imgui_impl_opengl3.h"
 
 #include "Window.h"
+#include "AllocationTracker.h"
+#include "FrameArena.h"
+#include "GpuProfiler.h"
+#include "Profiler.h"
 #include "Renderer.h"
+#include "Scenario.h"
+#include "Trace.h"
+
+// Global Constants
+namespace {
+
+	const int ALLOCATION_CHECK_WARMUP_FRAMES = 120; // Steps that may still grow buffers
+
+};
 
 // Local functions
 namespace {
@@ -22,31 +38,47 @@ void resetViewport(SDL_Window* window)
 
 };
 
-Window::Window(Program& program) : m_program(program) {}
+Window::Window(Program& program, const WindowOptions& options) : m_program(program), m_options(options) {}
 
 int Window::runMainLoop()
 {
 	// Initialize SDL and prepare SDL for openGL version 3.3 core
-	SDL_Init(SDL_INIT_VIDEO);
+	if (m_options.isHeadless) {
+		SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+	}
+	if (m_options.useSoftwareRenderer) {
+		SDL_setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+	}
+	if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+		SDL_Log("Failed to initialize SDL: %s", SDL_GetError());
+		return 1;
+	}
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
 
 	// Create SDL window
 	SDL_Window* window;
-	window = SDL_CreateWindow("Gravity Simulator", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 1280, 720, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
+	Uint32 windowFlags = SDL_WINDOW_OPENGL | (m_options.isHeadless ? SDL_WINDOW_HIDDEN : SDL_WINDOW_RESIZABLE);
+	window = SDL_CreateWindow("Gravity Simulator", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 1280, 720, windowFlags);
+	if (window == nullptr) {
+		SDL_Log("Failed to create window: %s", SDL_GetError());
+		SDL_Quit();
+		return 1;
+	}
 
 	// Create SDL openGL context and make current
 	SDL_GLContext glContext;
 	glContext = SDL_GL_CreateContext(window);
 	SDL_GL_MakeCurrent(window, glContext);
-	SDL_GL_SetSwapInterval(1);
+	SDL_GL_SetSwapInterval(m_options.isHeadless ? 0 : 1);
 
 	// Load glad
 	gladLoadGLLoader(SDL_GL_GetProcAddress);
 
 	// Set up Dear ImGui
 	IMGUI_CHECKVERSION();
+	ImGui::SetAllocatorFunctions(allocateTracked, freeTracked);
 	ImGui::CreateContext();
 	ImGui::StyleColorsDark();
 	ImGui_ImplSDL2_InitForOpenGL(window, glContext);
@@ -61,55 +93,194 @@ int Window::runMainLoop()
 	// Create renderer
 	Renderer renderer(window, glContext, io);
 
+	// Set up frame capture
+	std::unique_ptr<FrameCapture> capture;
+	if (!m_options.captureDirectory.empty()) {
+		capture.reset(new FrameCapture(m_options.captureWidth, m_options.captureHeight, m_options.captureDirectory, m_options.captureFormat));
+	}
+
+	// Set up tracing
+	setTraceThreadName("Main");
+	setTracingEnabled(m_options.isTracing);
+	setHardwareCountersEnabled(m_options.useHardwareCounters);
+
+	bool isOpen = true;
+	int exitCode = 0;
+
 	// Run m_program.load
 	m_program.load(renderer);
 
+	// Set up scenario playback
+	std::unique_ptr<ScenarioPlayer> scenario;
+	if (!m_options.scenarioPath.empty()) {
+		scenario.reset(new ScenarioPlayer());
+		if (!scenario->load(m_options.scenarioPath)) {
+			scenario.reset();
+			exitCode = 1;
+			isOpen = false;
+		}
+	}
+
+	if (m_options.checkAllocations && !isAllocationTrackingEnabled()) {
+		SDL_Log("--check-allocations needs a build with GRAVITY_TRACK_ALLOCATIONS");
+		exitCode = 1;
+		isOpen = false;
+	}
+
+	// Allocation check state
+	int steadyFrameCount = 0; // Consecutive frames without scenario input
+	int checkedFrameCount = 0;
+	int allocatingFrameCount = 0;
+	std::uint64_t maxStepAllocations = 0;
+
 	// main loop
-	bool isOpen = true;
+	int frameCount = 0;
 	SDL_Event e;
 
 	while (isOpen) {
-		while (SDL_PollEvent(&e)) {
-			if (e.type == SDL_QUIT) {
-				isOpen = false;
-			} else if (e.type == SDL_WINDOWEVENT) {
-				if (e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
-					resetViewport(window);
-					renderer.updateScalingFactor();
+		beginProfileFrame();
+		resetFrameArenas();
+
+		{
+			PROFILE_SCOPE("Events");
+
+			while (SDL_PollEvent(&e)) {
+				if (e.type == SDL_QUIT) {
+					isOpen = false;
+				} else if (e.type == SDL_WINDOWEVENT) {
+					if (e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+						resetViewport(window);
+						renderer.updateScalingFactor();
+					}
+				} else if (e.type == SDL_MOUSEBUTTONDOWN && !io.WantCaptureMouse) {
+					m_program.mousePressed(renderer, e.button);
 				}
-			} else if (e.type == SDL_MOUSEBUTTONDOWN && !io.WantCaptureMouse) {
-				m_program.mousePressed(renderer, e.button);
+				ImGui_ImplSDL2_ProcessEvent(&e);
+			}
+
+			if (scenario) {
+				scenario->sendProgramInput(m_program, renderer);
 			}
-			ImGui_ImplSDL2_ProcessEvent(&e);
 		}
 
 		// Update program
-		m_program.update(renderer);
+		{
+			PROFILE_SCOPE("Update");
+
+			std::uint64_t allocations = getTotalAllocationCount();
+			m_program.update(renderer);
+			allocations = getTotalAllocationCount() - allocations;
+
+			steadyFrameCount = !scenario || scenario->isRunning() ? steadyFrameCount + 1 : 0;
+			if (m_options.checkAllocations && steadyFrameCount > ALLOCATION_CHECK_WARMUP_FRAMES) {
+				checkedFrameCount++;
+				if (allocations > 0) {
+					allocatingFrameCount++;
+					maxStepAllocations = std::max(maxStepAllocations, allocations);
+				}
+			}
+		}
 
 		// Draw ImGui
-		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplSDL2_NewFrame(window);
-		ImGui::NewFrame();
+		{
+			PROFILE_SCOPE("Draw ImGui");
 
-		m_program.drawImGui(renderer);
+			ImGui_ImplOpenGL3_NewFrame();
+			ImGui_ImplSDL2_NewFrame(window);
+			if (scenario) {
+				scenario->sendImGuiInput();
+			}
+			ImGui::NewFrame();
 
-		ImGui::Render();
+			m_program.drawImGui(renderer);
+			drawImGuiProfiler(m_options.tracePath.c_str());
 
-		glClear(GL_COLOR_BUFFER_BIT);
+			ImGui::Render();
+		}
 
 		// Run m_program.draw
-		m_program.draw(renderer);
+		{
+			PROFILE_SCOPE("Draw");
+
+			if (capture) {
+				capture->beginFrame(renderer);
+			}
+
+			glClear(GL_COLOR_BUFFER_BIT);
+
+			m_program.draw(renderer);
+
+			if (capture) {
+				int width, height;
+				SDL_GetWindowSize(window, &width, &height);
+				capture->endFrame(renderer, width, height);
+			}
+		}
+
+		{
+			PROFILE_SCOPE("Render ImGui");
+			GPU_PROFILE_SCOPE("GPU ImGui");
+			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		}
+
+		{
+			PROFILE_SCOPE("Swap");
+			SDL_GL_SwapWindow(window);
+		}
+
+		PROFILE_COUNTER("Frame arena [KiB]", getFrameArenaUsage() / 1024.0);
+		PROFILE_COUNTER("Frame arena peak [KiB]", getFrameArenaPeakUsage() / 1024.0);
 
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		endProfileFrame();
+
+		frameCount++;
+		if (m_options.frameLimit > 0 && frameCount >= m_options.frameLimit) {
+			isOpen = false;
+		}
 
-		SDL_GL_SwapWindow(window);
+		if (scenario) {
+			scenario->endFrame();
+			if (scenario->isFinished()) {
+				isOpen = false;
+			}
+		}
+	}
+
+	if (m_options.isHeadless) {
+		printProfileSummary();
+	}
+
+	if (scenario && !scenario->report()) {
+		exitCode = 1;
+	}
+
+	if (m_options.checkAllocations && isAllocationTrackingEnabled()) {
+		if (checkedFrameCount == 0) {
+			SDL_Log("Allocation check: no steps after the %d step warm-up", ALLOCATION_CHECK_WARMUP_FRAMES);
+			exitCode = 1;
+		}
+		else if (allocatingFrameCount > 0) {
+			SDL_Log("Allocation check failed: %d of %d steps allocated, up to %llu times", allocatingFrameCount, checkedFrameCount,
+				static_cast<unsigned long long>(maxStepAllocations));
+			exitCode = 1;
+		}
+		else {
+			SDL_Log("Allocation check passed: %d steps without heap allocations", checkedFrameCount);
+		}
 	}
 
 	// clean up
+	capture.reset();
+	deleteGpuProfileQueries();
+
+	if (m_options.isTracing && !writeTrace(m_options.tracePath.c_str())) {
+		SDL_Log("Failed to write trace to %s", m_options.tracePath.c_str());
+	}
+
 	renderer.unload();
 	SDL_GL_DeleteContext(glContext);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 
-	return 0;
+	return exitCode;
 }
@@ -1,14 +1,49 @@
-
 #pragma once
 
+#include <string>
+
+#include "FrameCapture.h"
 #include "Program.h"
 
+struct WindowOptions {
+	// Runs without a visible window. SDL's offscreen video driver creates an
+	// EGL surfaceless context, which Mesa can back with llvmpipe.
+	bool isHeadless = false;
+	int frameLimit = 0; // Zero runs until the window is closed
+
+	// Captures every frame to numbered images when a directory is given
+	std::string captureDirectory;
+	int captureWidth = 1920;
+	int captureHeight = 1080;
+	CaptureFormat captureFormat = CaptureFormat::Png;
+
+	// Chrome trace written by the profiler. Giving one on the command line
+	// records from the first frame and saves on exit.
+	std::string tracePath = "trace.json";
+	bool isTracing = false;
+
+	bool useHardwareCounters = false;
+
+	// Scripted session to play back (see Scenario.h). The program exits when
+	// it ends, with a non-zero status if the scenario failed.
+	std::string scenarioPath;
+
+	// Asks Mesa for its software rasterizer, so runs work on machines without a GPU
+	bool useSoftwareRenderer = false;
+
+	// Exits with a non-zero status if a simulation step touches the heap once
+	// warmed up. With a scenario, only steps of its run commands are checked.
+	// Needs a build with allocation tracking (see AllocationTracker.h).
+	bool checkAllocations = false;
+};
+
 class Window {
 public:
-	explicit Window(Program&);
+	explicit Window(Program&, const WindowOptions& = WindowOptions());
 
 	int runMainLoop();
 
 private:
 	Program& m_program;
+	WindowOptions m_options;
 };
@@ -1,11 +1,92 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
+#include <SDL.h>
+
+#include "AccuracySweep.h"
 #include "GravitySimulator.h"
 #include "Window.h"
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
-	GravitySimulator gsim;
-	Window window(gsim);
+	WindowOptions options;
+	SimulationOptions simulationOptions;
+	AccuracyOptions accuracyOptions;
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+
+		if (std::strcmp(argv[i], "--headless") == 0) {
+			options.isHeadless = true;
+		}
+		else if (std::strcmp(argv[i], "--check-allocations") == 0) {
+			options.checkAllocations = true;
+		}
+		else if (std::strcmp(argv[i], "--perf-counters") == 0) {
+			options.useHardwareCounters = true;
+		}
+		else if (std::strcmp(argv[i], "--frames") == 0 && hasValue) {
+			options.frameLimit = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--capture") == 0 && hasValue) {
+			options.captureDirectory = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--capture-size") == 0 && hasValue) {
+			std::sscanf(argv[++i], "%dx%d", &options.captureWidth, &options.captureHeight);
+		}
+		else if (std::strcmp(argv[i], "--trace") == 0 && hasValue) {
+			options.tracePath = argv[++i];
+			options.isTracing = true;
+		}
+		else if (std::strcmp(argv[i], "--capture-format") == 0 && hasValue) {
+			options.captureFormat = std::strcmp(argv[++i], "raw") == 0 ? CaptureFormat::Raw : CaptureFormat::Png;
+		}
+		else if (std::strcmp(argv[i], "--scenario") == 0 && hasValue) {
+			options.scenarioPath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--software-gl") == 0) {
+			options.useSoftwareRenderer = true;
+		}
+		else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) {
+			simulationOptions.threadCount = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--deterministic") == 0) {
+			simulationOptions.isDeterministic = true;
+		}
+		else if (std::strcmp(argv[i], "--seed") == 0 && hasValue) {
+			simulationOptions.seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (std::strcmp(argv[i], "--record") == 0 && hasValue) {
+			simulationOptions.recordPath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--replay") == 0 && hasValue) {
+			simulationOptions.replayPath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--accuracy") == 0 && hasValue) {
+			accuracyOptions.outputPath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--accuracy-bodies") == 0 && hasValue) {
+			accuracyOptions.bodyCount = std::atoi(argv[++i]);
+		}
+	}
+
+	// A replay ignores live input and its events are not recorded again, so
+	// the log would not replay
+	if (!simulationOptions.recordPath.empty() && !simulationOptions.replayPath.empty()) {
+		SDL_Log("--record and --replay cannot be combined");
+		return 1;
+	}
+
+	// The sweep needs no window, so it runs instead of the simulator
+	if (!accuracyOptions.outputPath.empty()) {
+		accuracyOptions.threadCount = simulationOptions.threadCount;
+		accuracyOptions.seed = simulationOptions.seed;
+		return runAccuracySweep(accuracyOptions);
+	}
+
+	GravitySimulator gsim(simulationOptions);
+	Window window(gsim, options);
 
 	return window.runMainLoop();
 }